@@ -0,0 +1,197 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+
+#include "Arena.h"
+#include <assert.h>
+#include <algorithm>
+#include <sys/mman.h>
+
+
+
+
+
+using namespace std;
+
+
+
+
+
+/** Huge pages are 2MB on x86-64 and most arm64 configurations */
+static const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+
+
+
+Arena::Arena(size_t blockSize, bool hugePages)
+{
+	m_blockSize = blockSize;
+	m_hugePages = hugePages;
+
+	m_current = 0;
+	m_offset = 0;
+}
+
+Arena::~Arena()
+{
+	Reset();
+	Trim(0);
+}
+
+bool Arena::AddBlock(size_t size)
+{
+	size = max(size, m_blockSize);
+
+	//rounded so huge pages can back the whole block
+	size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+	void* pData = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (pData == MAP_FAILED)
+	{
+		return false;
+	}
+
+#ifdef MADV_HUGEPAGE
+
+	//just a hint, transparent huge pages might be disabled
+	if (m_hugePages)
+	{
+		madvise(pData, size, MADV_HUGEPAGE);
+	}
+
+#endif
+
+	Block block;
+	block.pData = (uint8_t*)pData;
+	block.size = size;
+
+	m_blocks.push_back(block);
+
+	return true;
+}
+
+void* Arena::Allocate(size_t size)
+{
+	lock_guard<mutex> l(m_mutex);
+
+	size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+	//the current block or the next ones kept from previous jobs
+	for (; m_current < m_blocks.size(); m_current++, m_offset = 0)
+	{
+		Block& block = m_blocks[m_current];
+
+		if (block.size - m_offset >= size)
+		{
+			void* pData = block.pData + m_offset;
+			m_offset += size;
+
+			return pData;
+		}
+	}
+
+	if (!AddBlock(size))
+	{
+		return NULL;
+	}
+
+	m_current = m_blocks.size() - 1;
+	m_offset = size;
+
+	return m_blocks[m_current].pData;
+}
+
+void Arena::Reset(size_t keepBytes)
+{
+	lock_guard<mutex> l(m_mutex);
+
+	//whole huge pages are kept, so they are not split
+	if (keepBytes < (size_t)-1 - HUGE_PAGE_SIZE)
+	{
+		keepBytes = (keepBytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+	}
+
+	size_t start = 0;
+
+	//only the blocks used since the last reset, the rest were released then
+	for (size_t i = 0; i < m_blocks.size() && i <= m_current; i++)
+	{
+		const Block& block = m_blocks[i];
+
+		size_t used = (i < m_current) ? block.size : m_offset;
+
+		//rounded to whole pages, the blocks are page aligned and sized
+		used = min((used + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1), block.size);
+
+		size_t kept = (keepBytes > start) ? min(keepBytes - start, used) : 0;
+
+		if (kept < used)
+		{
+			madvise(block.pData + kept, used - kept, MADV_DONTNEED);
+		}
+
+		start += block.size;
+	}
+
+	m_current = 0;
+	m_offset = 0;
+}
+
+void Arena::Trim(size_t maxBytes)
+{
+	lock_guard<mutex> l(m_mutex);
+
+	assert(m_current == 0 && m_offset == 0);
+
+	size_t kept = 0;
+	size_t count = 0;
+
+	for (; count < m_blocks.size(); count++)
+	{
+		if (kept + m_blocks[count].size > maxBytes)
+		{
+			break;
+		}
+
+		kept += m_blocks[count].size;
+	}
+
+	for (size_t i = count; i < m_blocks.size(); i++)
+	{
+		munmap(m_blocks[i].pData, m_blocks[i].size);
+	}
+
+	m_blocks.resize(count);
+}
+
+size_t Arena::GetCapacity()
+{
+	lock_guard<mutex> l(m_mutex);
+
+	size_t capacity = 0;
+
+	for (size_t i = 0; i < m_blocks.size(); i++)
+	{
+		capacity += m_blocks[i].size;
+	}
+
+	return capacity;
+}
@@ -0,0 +1,121 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+#ifndef __KTXTOOL_ARENA_INCLUDED
+#define __KTXTOOL_ARENA_INCLUDED
+
+
+
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <vector>
+#include <mutex>
+
+
+
+
+
+/** Bump allocator for the image buffers of a job. The memory comes in big
+ *  blocks mapped straight from the system (not the heap), page aligned and
+ *  optionally backed by huge pages. Nothing is freed individually, the whole
+ *  arena is reset at once when the job ends and the blocks are reused by the
+ *  next job, so a long batch doesn't fragment the heap. Thread safe. */
+class Arena
+{
+	struct Block
+	{
+		uint8_t* pData;
+		size_t   size;
+	};
+
+	std::vector<Block> m_blocks;
+
+	/** The block being filled and the offset in it */
+	size_t             m_current;
+	size_t             m_offset;
+
+	size_t             m_blockSize;
+	bool               m_hugePages;
+
+	std::mutex         m_mutex;
+
+
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+
+	/** Maps a new block of at least size bytes */
+	bool AddBlock(size_t size);
+
+public:
+
+
+	/** Alignment of every allocation, a cache line (and enough for AVX) */
+	static const size_t ALIGNMENT = 64;
+
+	static const size_t DEFAULT_BLOCK_SIZE = 64 << 20;
+
+
+	/** blockSize is the minimum size of the blocks mapped, bigger allocations
+	 *  get a block of their own */
+	Arena(size_t blockSize = DEFAULT_BLOCK_SIZE, bool hugePages = false);
+
+
+
+	/** Unmaps all the blocks */
+	~Arena();
+
+
+
+	/** Returns size bytes aligned to ALIGNMENT, uninitialized. Returns NULL if
+	 *  the system is out of memory */
+	void* Allocate(size_t size);
+
+
+
+	/** Forgets all the allocations, the blocks are kept for reuse. The pages
+	 *  used beyond the first keepBytes are given back to the system, mapped
+	 *  still but no longer resident, so a big job doesn't leave its memory
+	 *  dirty for the next one. The buffers allocated must not be used anymore */
+	void Reset(size_t keepBytes = (size_t)-1);
+
+
+
+	/** Unmaps the blocks beyond the first maxBytes, so a big job doesn't keep 
+	 *  its memory forever. Only between jobs, ie. after Reset */
+	void Trim(size_t maxBytes);
+
+
+
+	/** Bytes mapped */
+	size_t GetCapacity();
+
+};
+
+
+
+
+
+
+
+
+
+#endif
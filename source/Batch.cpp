@@ -0,0 +1,447 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include "Batch.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <stdlib.h>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <sys/stat.h>
+#include "ktxtool.h"
+#include "InputFormat.h"
+#include "PixelData.h"
+#include "Parallel.h"
+#include "Pipeline.h"
+#include "Arena.h"
+#include <memory>
+
+
+
+
+
+using namespace std;
+
+
+
+
+
+bool ParseStageLimits(const string& value, BatchSettings& settings)
+{
+	int* limits[] = 
+	{
+		&settings.decodeThreads, 
+		&settings.convertThreads, 
+		&settings.encodeThreads, 
+		&settings.writeThreads
+	};
+
+	std::istringstream ss(value);
+	std::string token;
+
+	int count = 0;
+
+	while (std::getline(ss, token, ','))
+	{
+		if (count == 4)
+		{
+			return false;
+		}
+
+		int limit = atoi(token.c_str());
+
+		if (limit <= 0)
+		{
+			return false;
+		}
+
+		*limits[count++] = limit;
+	}
+
+	return count == 4;
+}
+
+/** Reads the dimensions of the first face from its header, the rest of
+ *  the faces must match it anyway. Returns the pixel count of the face */
+static double ReadJobInfo(const Job& job, Format& format, SampleType& type)
+{
+	if (job.faces.size() == 0)
+	{
+		return 0.0;
+	}
+
+	const string& fileName = job.faces[0];
+
+	int w, h;
+
+	InputFormat* pFormat = FindInputFormat(fileName);
+
+	if (pFormat && pFormat->ReadInfo(fileName.c_str(), w, h, format, type))
+	{
+		return (double)w * h;
+	}
+
+	//unknown, guess from the file size as if it was uncompressed RGB
+	format = FORMAT_RGB;
+	type = SAMPLE_UINT8;
+
+	struct stat st;
+
+	if (stat(fileName.c_str(), &st) == 0)
+	{
+		return st.st_size / 3.0;
+	}
+
+	return 0.0;
+}
+
+double EstimateJobCost(const Job& job)
+{
+	Format format;
+	SampleType type;
+
+	double pixels = ReadJobInfo(job, format, type);
+
+	//all the faces match the first one, and the mipmaps add a third
+	pixels *= job.faces.size();
+	pixels *= 4.0 / 3.0;
+
+	//relative cost per pixel, the ETC1 encode is way more expensive than the rest
+	double perPixel = 1.0;
+
+	if (job.compress)
+	{
+		switch (job.quality)
+		{
+		case Compression::QUALITY_DRAFT:
+		case Compression::QUALITY_LOW:    perPixel += 8.0; break;
+		case Compression::QUALITY_MEDIUM: perPixel += 40.0; break;
+		case Compression::QUALITY_HIGH:   perPixel += 200.0; break;
+		}
+	}
+
+	return pixels * perPixel;
+}
+
+/** Memory kept mapped by each arena between jobs, the rest is unmapped */
+static const size_t ARENA_RETAIN = 256 << 20;
+
+/** Memory left resident by each arena between jobs, the rest of the pages
+ *  used are given back to the system */
+static const size_t ARENA_RESIDENT = 32 << 20;
+
+uint64_t EstimateJobMemory(const Job& job)
+{
+	Format format;
+	SampleType type;
+
+	double pixels = ReadJobInfo(job, format, type) * job.faces.size();
+
+	double components = (format == FORMAT_RGBA) ? 4.0 : 3.0;
+
+	//decoded faces wider than 8 bits, on the heap until converted
+	double bytes = 0.0;
+
+	if (type != SAMPLE_UINT8)
+	{
+		bytes += pixels * components * GetSampleSize(type);
+	}
+
+	//8-bit mipmap chain in the arena, the top level is the decoded face if 8-bit
+	bytes += pixels * components * 4.0 / 3.0;
+
+	//ETC1 is 4 bits per pixel
+	if (job.compress)
+	{
+		bytes += pixels * 0.5 * 4.0 / 3.0;
+	}
+
+	//the arena peaks at the allocations above plus the pages the previous job left resident
+	bytes += ARENA_RESIDENT;
+
+	return (uint64_t)bytes;
+}
+
+
+
+
+/** Blocking budget, a reservation waits until the previous ones leave room
+ *  for it. A reservation bigger than the whole budget is admitted alone, as
+ *  otherwise it would never run. */
+class MemoryBudget
+{
+	uint64_t           m_max;
+	uint64_t           m_used;
+
+	mutex              m_mutex;
+	condition_variable m_released;
+
+public:
+
+
+	MemoryBudget(uint64_t max)
+	{
+		m_max = max;
+		m_used = 0;
+	}
+
+	void Acquire(uint64_t bytes)
+	{
+		if (m_max == 0)
+		{
+			return;
+		}
+
+		unique_lock<mutex> l(m_mutex);
+
+		m_released.wait(l, [&]() { return m_used == 0 || m_used + bytes <= m_max; });
+
+		m_used += bytes;
+	}
+
+	void Release(uint64_t bytes)
+	{
+		if (m_max == 0)
+		{
+			return;
+		}
+
+		lock_guard<mutex> l(m_mutex);
+
+		m_used -= bytes;
+
+		m_released.notify_all();
+	}
+};
+
+/** Arenas for the jobs in flight, a job takes one and gives it back reset
+ *  when done, so the memory is reused instead of going back to the heap */
+class ArenaPool
+{
+	vector<unique_ptr<Arena> > m_arenas;
+	vector<Arena*>             m_free;
+
+	bool                       m_hugePages;
+
+	mutex                      m_mutex;
+
+public:
+
+
+	ArenaPool(bool hugePages)
+	{
+		m_hugePages = hugePages;
+	}
+
+	Arena* Acquire()
+	{
+		lock_guard<mutex> l(m_mutex);
+
+		if (m_free.empty())
+		{
+			m_arenas.push_back(unique_ptr<Arena>(new Arena(Arena::DEFAULT_BLOCK_SIZE, m_hugePages)));
+			m_free.push_back(m_arenas.back().get());
+		}
+
+		Arena* pArena = m_free.back();
+		m_free.pop_back();
+
+		return pArena;
+	}
+
+	/** The buffers allocated from the arena must be gone */
+	void Release(Arena* pArena)
+	{
+		pArena->Reset(ARENA_RESIDENT);
+		pArena->Trim(ARENA_RETAIN);
+
+		lock_guard<mutex> l(m_mutex);
+
+		m_free.push_back(pArena);
+	}
+};
+
+int RunBatch(JobArray& jobs, const BatchSettings& settings)
+{
+	size_t failed = 0;
+	size_t cached = 0;
+	uint64_t pixelCount = 0;
+
+	auto start = chrono::steady_clock::now();
+
+
+	vector<JobData*> items;
+
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		items.push_back(new JobData(&jobs[i], settings.pCache));
+	}
+
+
+	//longest processing time first, reading the headers might be slow so in parallel
+	if (settings.schedule)
+	{
+		vector<pair<double, JobData*> > byCost(items.size());
+
+		ParallelFor(0, (int)items.size(), 16, [&](int first, int last)
+		{
+			for (int i = first; i < last; i++)
+			{
+				byCost[i] = make_pair(EstimateJobCost(*items[i]->pJob), items[i]);
+			}
+		});
+
+		stable_sort(byCost.begin(), byCost.end(), [](const pair<double, JobData*>& a, const pair<double, JobData*>& b)
+		{
+			return a.first > b.first;
+		});
+
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			items[i] = byCost[i].second;
+		}
+	}
+
+
+	//the estimates read the headers, so only if there's a budget
+	MemoryBudget budget(settings.maxMemory);
+
+	ArenaPool arenas(settings.hugePages);
+
+	if (settings.maxMemory > 0)
+	{
+		ParallelFor(0, (int)items.size(), 16, [&](int first, int last)
+		{
+			for (int i = first; i < last; i++)
+			{
+				items[i]->memory = EstimateJobMemory(*items[i]->pJob);
+			}
+		});
+
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			if (items[i]->memory > settings.maxMemory)
+			{
+				cout << "Job " << items[i]->pJob->output << " needs " << (items[i]->memory >> 20);
+				cout << "MB, over the memory budget so it runs alone" << endl;
+			}
+		}
+	}
+
+
+	//all jobs run in this process, so the formats and encoder tables are only initialized once
+	Pipeline<JobData*> pipeline;
+
+	//ie. out of memory in the arena or a scratch file, only that job fails
+	pipeline.SetErrorHandler([](JobData*& pData, const string& stage, const char* message)
+	{
+		cerr << "Error in the " << stage << " stage of " << pData->pJob->output << ": " << message << endl;
+
+		pData->error = 19;
+	});
+
+	//waits for room in the memory budget before decoding, released once done
+	pipeline.AddStage("admit", 1, [&](JobData*& pData)
+	{
+		budget.Acquire(pData->memory);
+
+		pData->pArena = arenas.Acquire();
+	});
+
+	//a stage is skipped if the job already failed or is done
+	auto AddStage = [&](const char* name, int concurrency, int (*fn)(JobData&))
+	{
+		pipeline.AddStage(name, concurrency, [fn](JobData*& pData)
+		{
+			if (pData->error == 0 && !pData->done)
+			{
+				fn(*pData);
+			}
+		});
+	};
+
+	AddStage("decode", settings.decodeThreads, DecodeJob);
+	AddStage("convert", settings.convertThreads, ConvertJob);
+	AddStage("encode", settings.encodeThreads, EncodeJob);
+	AddStage("write", settings.writeThreads, WriteJob);
+
+	size_t finished = 0;
+
+	pipeline.AddStage("done", 1, [&](JobData*& pData)
+	{
+		Job& job = *pData->pJob;
+
+		job.result = pData->error;
+
+		finished++;
+
+		if (pData->error != 0)
+		{
+			cerr << "Job " << finished << "/" << jobs.size() << " failed (" << job.output << ")" << endl;
+			failed++;
+		}
+		else
+		{
+			cout << "Job " << finished << "/" << jobs.size() << ": " << job.output << endl;
+			pixelCount += job.pixelCount;
+
+			if (pData->done)
+			{
+				cached++;
+			}
+		}
+
+		//frees the container as soon as the job is done
+		budget.Release(pData->memory);
+
+		Arena* pArena = pData->pArena;
+
+		delete pData;
+		pData = nullptr;
+
+		arenas.Release(pArena);
+	});
+
+	pipeline.Run(items);
+
+
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	double seconds = elapsed.count() > 0.0 ? elapsed.count() : 1e-9;
+
+	cout << endl;
+	cout << "Batch: " << (jobs.size() - failed) << "/" << jobs.size() << " jobs in ";
+	cout << fixed << setprecision(2) << seconds << "s, ";
+	cout << (jobs.size() - failed) / seconds << " jobs/s, ";
+	cout << (pixelCount / 1e6) / seconds << " MPix/s";
+
+	if (settings.pCache)
+	{
+		cout << ", " << cached << " from cache";
+	}
+
+	cout << endl;
+
+	return failed == 0 ? 0 : 17;
+}
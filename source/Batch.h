@@ -0,0 +1,121 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __KTXTOOL_BATCH_INCLUDED
+#define __KTXTOOL_BATCH_INCLUDED
+
+
+
+
+#include <string>
+#include "Job.h"
+
+
+
+class OutputCache;
+
+
+
+
+
+/** Settings of a batch run */
+struct BatchSettings
+{
+	/** Concurrency limit of each stage, how many jobs can be in it at once */
+	int decodeThreads;
+	int convertThreads;
+	int encodeThreads;
+	int writeThreads;
+
+	/** Optional, outputs already converted are taken from here */
+	OutputCache* pCache;
+
+	/** Starts the most expensive jobs first instead of using the jobs order */
+	bool         schedule;
+
+	/** Memory budget in bytes for the jobs in flight, zero is unlimited */
+	uint64_t     maxMemory;
+
+	/** The job arenas are backed by huge pages if the system allows it */
+	bool         hugePages;
+
+	BatchSettings()
+	{
+		pCache = NULL;
+		schedule = true;
+		maxMemory = 0;
+		hugePages = false;
+
+		decodeThreads = 2;
+		convertThreads = 1;
+		encodeThreads = 1;
+		writeThreads = 1;
+	}
+};
+
+
+
+
+/** Parses the stage limits as "DECODE,CONVERT,ENCODE,WRITE", ie. 2,1,1,1
+ *
+ *  Returns false if the value is invalid */
+bool ParseStageLimits(const std::string& value, BatchSettings& settings);
+
+
+
+
+/** Estimates the relative cost of a job from the dimensions of its first face
+ *  (read from the header), the amount of faces, mipmaps and the compression */
+double EstimateJobCost(const Job& job);
+
+
+
+
+/** Estimates the peak memory of a job in bytes, the decoded faces wider than 8 bits,
+ *  the 8-bit mipmap chain, the compressed data and what its arena keeps resident */
+uint64_t EstimateJobMemory(const Job& job);
+
+
+
+
+/** Runs all the jobs through a pipeline, while a job is being encoded the 
+ *  next one is decoded and the previous one written. When scheduling, the jobs
+ *  start longest first so the small ones fill the gaps at the end. With a memory
+ *  budget a job waits before decoding until the jobs in flight leave room for
+ *  it. The image buffers of each job come from an arena, reused by the next
+ *  jobs. Reports the aggregate throughput at the end.
+ *
+ *  Returns zero if all the jobs succeeded */
+int RunBatch(JobArray& jobs, const BatchSettings& settings);
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+#endif
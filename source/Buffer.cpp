@@ -0,0 +1,126 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+
+#include "Buffer.h"
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+
+
+
+
+using namespace std;
+
+
+
+
+
+string Buffer::s_scratchDir;
+size_t Buffer::s_scratchMinSize = 0;
+
+
+
+
+void Buffer::SetScratch(const string& dir, size_t minSize)
+{
+	s_scratchDir = dir;
+	s_scratchMinSize = minSize;
+}
+
+uint8_t* Buffer::MapScratch(size_t size)
+{
+	static atomic<bool> warned(false);
+
+	string path = s_scratchDir + "/ktxtool.XXXXXX";
+
+	vector<char> name(path.begin(), path.end());
+	name.push_back('\0');
+
+	int fd = mkstemp(name.data());
+
+	if (fd < 0)
+	{
+		if (!warned.exchange(true))
+		{
+			cerr << "Unable to create a scratch file in " << s_scratchDir << ", using memory instead" << endl;
+		}
+
+		return nullptr;
+	}
+
+	//the mapping keeps the file alive, it's gone once unmapped (or if the process dies)
+	unlink(name.data());
+
+	//the blocks are reserved now, a sparse file would fail later with a SIGBUS
+	//when the disk fills up while writing the mapping
+	int error = posix_fallocate(fd, 0, size);
+
+	void* pData = MAP_FAILED;
+
+	if (error == 0)
+	{
+		pData = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+
+	close(fd);
+
+	if (pData == MAP_FAILED)
+	{
+		if (!warned.exchange(true))
+		{
+			cerr << "Unable to map a scratch file of " << size << " bytes";
+
+			if (error != 0)
+			{
+				cerr << " (" << strerror(error) << ")";
+			}
+
+			cerr << ", using memory instead" << endl;
+		}
+
+		return nullptr;
+	}
+
+	//the kernels walk the images in bands of rows, read ahead helps paging in
+	madvise(pData, size, MADV_SEQUENTIAL);
+
+	return (uint8_t*)pData;
+}
+
+void Buffer::UnmapScratch(uint8_t* pData, size_t size)
+{
+	munmap(pData, size);
+}
+
+void Buffer::Evict() const
+{
+	//shared file pages, the contents stay in the file (not so for anonymous memory)
+	if (m_mapped)
+	{
+		madvise(m_pData, m_size, MADV_DONTNEED);
+	}
+}
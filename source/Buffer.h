@@ -0,0 +1,196 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+#ifndef __KTXTOOL_BUFFER_INCLUDED
+#define __KTXTOOL_BUFFER_INCLUDED
+
+
+
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <utility>
+#include <new>
+#include <string>
+#include <Arena.h>
+
+
+
+
+
+/** Owning byte buffer, the memory is freed with the buffer. It can't be
+ *  copied, only moved, so the ownership of the pixels is always clear as
+ *  they go from the decoder to the container. 
+ *
+ *  The memory can come from an arena instead of the heap, then it's released
+ *  with the arena (Arena::Reset) and the buffer must not outlive that. 
+ *
+ *  Large buffers can be backed by a scratch file instead (see SetScratch), 
+ *  the pages are written to disk as the system needs the memory so images
+ *  larger than the RAM can be processed. */
+class Buffer
+{
+	uint8_t* m_pData;
+	size_t   m_size;
+	Arena*   m_pArena;
+	bool     m_mapped;
+
+	/** Scratch file settings, zero means no scratch files */
+	static std::string s_scratchDir;
+	static size_t      s_scratchMinSize;
+
+	/** Maps a new scratch file of size bytes, NULL if it couldn't */
+	static uint8_t* MapScratch(size_t size);
+	static void UnmapScratch(uint8_t* pData, size_t size);
+
+	Buffer(const Buffer&);
+	Buffer& operator=(const Buffer&);
+
+public:
+
+
+	inline Buffer()
+	{
+		m_pData = nullptr;
+		m_size = 0;
+		m_pArena = nullptr;
+		m_mapped = false;
+	}
+
+	/** Allocates size bytes, uninitialized, from a scratch file if it's large
+	 *  enough, otherwise from the arena if any */
+	inline explicit Buffer(size_t size, Arena* pArena = nullptr)
+	{
+		m_pData = nullptr;
+		m_size = size;
+		m_pArena = pArena;
+		m_mapped = false;
+
+		if (s_scratchMinSize > 0 && size >= s_scratchMinSize)
+		{
+			//if the file can't be created the memory is used anyway
+			m_pData = MapScratch(size);
+			m_mapped = m_pData != nullptr;
+
+			if (m_mapped)
+			{
+				m_pArena = nullptr;
+				return;
+			}
+		}
+
+		if (size && pArena)
+		{
+			m_pData = (uint8_t*)pArena->Allocate(size);
+
+			if (m_pData == nullptr)
+			{
+				throw std::bad_alloc();
+			}
+		}
+		else if (size)
+		{
+			m_pData = new uint8_t[size];
+		}
+	}
+
+	inline Buffer(Buffer&& other) noexcept
+	{
+		m_pData = other.m_pData;
+		m_size = other.m_size;
+		m_pArena = other.m_pArena;
+		m_mapped = other.m_mapped;
+
+		other.m_pData = nullptr;
+		other.m_size = 0;
+		other.m_pArena = nullptr;
+		other.m_mapped = false;
+	}
+
+	inline Buffer& operator=(Buffer&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+
+			std::swap(m_pData, other.m_pData);
+			std::swap(m_size, other.m_size);
+			std::swap(m_pArena, other.m_pArena);
+			std::swap(m_mapped, other.m_mapped);
+		}
+
+		return *this;
+	}
+
+	inline ~Buffer()
+	{
+		Reset();
+	}
+
+	/** Frees the memory, the buffer is empty afterwards. The arena memory
+	 *  is released with the arena */
+	inline void Reset()
+	{
+		if (m_mapped)
+		{
+			UnmapScratch(m_pData, m_size);
+		}
+		else if (m_pArena == nullptr)
+		{
+			delete[] m_pData;
+		}
+
+		m_pData = nullptr;
+		m_size = 0;
+		m_pArena = nullptr;
+		m_mapped = false;
+	}
+
+	/** Hint, the pixels won't be used for a while. A scratch file buffer gives
+	 *  its pages back (they're read again from the file when needed), other
+	 *  buffers are left as they are */
+	void Evict() const;
+
+	inline uint8_t* Get() const { return m_pData; }
+
+	inline size_t GetSize() const { return m_size; }
+
+	inline bool IsEmpty() const { return m_pData == nullptr; }
+
+	inline bool IsMapped() const { return m_mapped; }
+
+
+
+	/** Buffers of minSize bytes or more are backed by a file in the directory
+	 *  instead of memory. The files are deleted as soon as they are created, so 
+	 *  nothing is left behind. Zero disables it. Must be called before any 
+	 *  buffer is allocated, ie. while parsing the options */
+	static void SetScratch(const std::string& dir, size_t minSize);
+};
+
+
+
+
+
+
+
+
+
+#endif
@@ -0,0 +1,237 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include "Cache.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <functional>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+
+
+
+
+#define CACHE_ENTRY_EXT ".ktx"
+
+
+
+
+
+using namespace std;
+
+
+
+
+
+static bool CopyFile(const string& srcPath, const string& filePath)
+{
+	ifstream src(srcPath.c_str(), ifstream::binary);
+	ofstream dst(filePath.c_str(), ofstream::binary | ofstream::trunc);
+
+	if (!src.is_open() || !dst.is_open())
+	{
+		return false;
+	}
+
+	dst << src.rdbuf();
+
+	return dst.good();
+}
+
+bool LinkOrCopyFile(const string& srcPath, const string& filePath)
+{
+	//build it aside and rename it, the destination is never seen half written
+	string tmpPath = filePath + ".tmp" + to_string(hash<thread::id>()(this_thread::get_id()));
+
+	unlink(tmpPath.c_str());
+
+	if (link(srcPath.c_str(), tmpPath.c_str()) != 0 && !CopyFile(srcPath, tmpPath))
+	{
+		unlink(tmpPath.c_str());
+		return false;
+	}
+
+	bool renamed = rename(tmpPath.c_str(), filePath.c_str()) == 0;
+
+	//if both were already the same file rename does nothing
+	unlink(tmpPath.c_str());
+
+	return renamed;
+}
+
+OutputCache::OutputCache()
+{
+	m_maxSize = 0;
+	m_size = 0;
+}
+
+string OutputCache::GetEntryPath(const string& key) const
+{
+	return m_dir + "/" + key + CACHE_ENTRY_EXT;
+}
+
+bool OutputCache::Open(const string& dir, uint64_t maxSize)
+{
+	lock_guard<mutex> l(m_mutex);
+
+	m_dir = dir;
+	m_maxSize = maxSize;
+	m_size = 0;
+	m_entries.clear();
+
+	if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+	{
+		cerr << "Couldn't create the cache directory '" << dir << "'" << endl;
+		return false;
+	}
+
+	DIR* pDir = opendir(dir.c_str());
+
+	if (!pDir)
+	{
+		cerr << "Couldn't open the cache directory '" << dir << "'" << endl;
+		return false;
+	}
+
+	const string ext = CACHE_ENTRY_EXT;
+
+	while (dirent* pEntry = readdir(pDir))
+	{
+		string name = pEntry->d_name;
+
+		if (name.size() <= ext.size() || name.compare(name.size() - ext.size(), ext.size(), ext) != 0)
+		{
+			continue;
+		}
+
+		struct stat st;
+
+		if (stat((dir + "/" + name).c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+		{
+			continue;
+		}
+
+		//the modification time is used as the last use time
+		Entry& entry = m_entries[name.substr(0, name.size() - ext.size())];
+		entry.size = st.st_size;
+		entry.lastUse = st.st_mtime;
+
+		m_size += entry.size;
+	}
+
+	closedir(pDir);
+
+	Evict();
+
+	return true;
+}
+
+bool OutputCache::Fetch(const string& key, const string& outputPath)
+{
+	string entryPath;
+
+	{
+		lock_guard<mutex> l(m_mutex);
+
+		EntryMap::iterator it = m_entries.find(key);
+
+		if (it == m_entries.end())
+		{
+			return false;
+		}
+
+		it->second.lastUse = time(NULL);
+
+		entryPath = GetEntryPath(key);
+	}
+
+	//touch it so the next runs know it was used recently
+	utime(entryPath.c_str(), NULL);
+
+	return LinkOrCopyFile(entryPath, outputPath);
+}
+
+void OutputCache::Store(const string& key, const string& filePath)
+{
+	string entryPath = GetEntryPath(key);
+
+	struct stat st;
+
+	if (stat(filePath.c_str(), &st) != 0 || !LinkOrCopyFile(filePath, entryPath))
+	{
+		cerr << "Couldn't store '" << filePath << "' in the cache" << endl;
+		return;
+	}
+
+	lock_guard<mutex> l(m_mutex);
+
+	EntryMap::iterator it = m_entries.find(key);
+
+	if (it != m_entries.end())
+	{
+		m_size -= it->second.size;
+	}
+
+	Entry& entry = m_entries[key];
+	entry.size = st.st_size;
+	entry.lastUse = time(NULL);
+
+	m_size += entry.size;
+
+	Evict();
+}
+
+void OutputCache::Evict()
+{
+	if (m_size <= m_maxSize)
+	{
+		return;
+	}
+
+	vector<pair<int64_t, string> > byAge;
+
+	for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end(); it++)
+	{
+		byAge.push_back(make_pair(it->second.lastUse, it->first));
+	}
+
+	sort(byAge.begin(), byAge.end());
+
+	for (size_t i = 0; i < byAge.size() && m_size > m_maxSize; i++)
+	{
+		const string& key = byAge[i].second;
+
+		unlink(GetEntryPath(key).c_str());
+
+		m_size -= m_entries[key].size;
+		m_entries.erase(key);
+	}
+}
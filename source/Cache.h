@@ -0,0 +1,117 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __KTXTOOL_CACHE_INCLUDED
+#define __KTXTOOL_CACHE_INCLUDED
+
+
+
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <inttypes.h>
+
+
+
+
+
+/** On-disk cache of previously produced ktx files, addressed by a key that 
+ *  identifies the inputs and settings (see Hash). Entries are hardlinked 
+ *  (or copied if that's not possible) in and out of the cache directory, and 
+ *  the least recently used ones are evicted when the size limit is reached.
+ *  Safe to use from several threads. */
+class OutputCache
+{
+protected:
+
+	struct Entry
+	{
+		uint64_t size;
+		int64_t  lastUse;
+	};
+
+	typedef std::map<std::string, Entry> EntryMap;
+
+
+	std::string m_dir;
+	uint64_t    m_maxSize;
+	uint64_t    m_size;
+	EntryMap    m_entries;
+
+	std::mutex  m_mutex;
+
+
+	std::string GetEntryPath(const std::string& key) const;
+
+
+	/** Removes the least recently used entries until the size fits the limit */
+	void Evict();
+
+public:
+
+
+	OutputCache();
+
+
+
+	/** Opens (creates if needed) the cache directory and indexes its entries.
+	 *  maxSize is the size limit in bytes.
+	 *
+	 *  Returns false if the directory couldn't be created */
+	bool Open(const std::string& dir, uint64_t maxSize);
+
+
+
+	/** Places the cached file for the key at outputPath, replacing it.
+	 *
+	 *  Returns false on a cache miss */
+	bool Fetch(const std::string& key, const std::string& outputPath);
+
+
+
+	/** Adds a produced file to the cache under the key */
+	void Store(const std::string& key, const std::string& filePath);
+
+};
+
+
+
+
+/** Makes filePath a hardlink of srcPath, or a copy if linking fails. The
+ *  destination is replaced (not overwritten) so other links aren't modified.
+ *
+ *  Returns false if neither was possible */
+bool LinkOrCopyFile(const std::string& srcPath, const std::string& filePath);
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+#endif
@@ -0,0 +1,311 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include "Dependencies.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include "Hash.h"
+#include "Parallel.h"
+
+
+
+
+
+#define DEPENDENCIES_MAGIC "ktxtool-dependencies 2"
+
+
+
+
+
+using namespace std;
+
+
+
+
+
+static bool StatFile(const string& filePath, int64_t& mtime, uint64_t& size)
+{
+	struct stat st;
+
+	if (stat(filePath.c_str(), &st) != 0)
+	{
+		return false;
+	}
+
+#if defined(__APPLE__)
+	mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+
+	size = st.st_size;
+
+	return true;
+}
+
+static void SplitTabs(const string& line, vector<string>& fields)
+{
+	fields.clear();
+
+	std::istringstream ss(line);
+	std::string field;
+
+	while (std::getline(ss, field, '\t'))
+	{
+		fields.push_back(field);
+	}
+}
+
+bool DependencyDB::Load(const string& filePath)
+{
+	m_filePath = filePath;
+	m_records.clear();
+
+	ifstream file(filePath.c_str());
+
+	//first run
+	if (!file.is_open())
+	{
+		return true;
+	}
+
+	string line;
+
+	if (!getline(file, line) || line != DEPENDENCIES_MAGIC)
+	{
+		cerr << "Invalid dependency database '" << filePath << "', it will be rebuilt" << endl;
+		return true;
+	}
+
+	vector<string> fields;
+	Record* pRecord = NULL;
+
+	//job\tOUTPUT\tSETTINGS followed by out\tMTIME\tSIZE of the output and
+	//in\tMTIME\tSIZE\tHASH\tPATH for each face
+	while (getline(file, line))
+	{
+		SplitTabs(line, fields);
+
+		if (fields.size() == 3 && fields[0] == "job")
+		{
+			pRecord = &m_records[fields[1]];
+			*pRecord = Record();
+			pRecord->settings = fields[2];
+		}
+		else if (fields.size() == 3 && fields[0] == "out" && pRecord)
+		{
+			pRecord->outputMtime = strtoll(fields[1].c_str(), NULL, 10);
+			pRecord->outputSize = strtoull(fields[2].c_str(), NULL, 10);
+		}
+		else if (fields.size() == 5 && fields[0] == "in" && pRecord)
+		{
+			Input input;
+			input.mtime = strtoll(fields[1].c_str(), NULL, 10);
+			input.size = strtoull(fields[2].c_str(), NULL, 10);
+			input.hash = fields[3];
+			input.path = fields[4];
+
+			pRecord->inputs.push_back(input);
+		}
+		else
+		{
+			cerr << "Invalid dependency database '" << filePath << "', it will be rebuilt" << endl;
+			m_records.clear();
+			return true;
+		}
+	}
+
+	return !file.bad();
+}
+
+bool DependencyDB::Save()
+{
+	lock_guard<mutex> l(m_mutex);
+
+	//written aside and renamed, an interrupted run never leaves it half written
+	string tmpPath = m_filePath + ".tmp";
+
+	ofstream file(tmpPath.c_str(), ofstream::trunc);
+
+	if (!file.is_open())
+	{
+		cerr << "Couldn't write the dependency database '" << m_filePath << "'" << endl;
+		return false;
+	}
+
+	file << DEPENDENCIES_MAGIC << "\n";
+
+	for (RecordMap::const_iterator it = m_records.begin(); it != m_records.end(); it++)
+	{
+		const Record& record = it->second;
+
+		file << "job\t" << it->first << "\t" << record.settings << "\n";
+		file << "out\t" << record.outputMtime << "\t" << record.outputSize << "\n";
+
+		for (size_t i = 0; i < record.inputs.size(); i++)
+		{
+			const Input& input = record.inputs[i];
+
+			file << "in\t" << input.mtime << "\t" << input.size << "\t" << input.hash << "\t" << input.path << "\n";
+		}
+	}
+
+	file.close();
+
+	if (file.fail() || rename(tmpPath.c_str(), m_filePath.c_str()) != 0)
+	{
+		cerr << "Couldn't write the dependency database '" << m_filePath << "'" << endl;
+		remove(tmpPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool DependencyDB::CheckJob(const Job& job, Record& current)
+{
+	current.settings = GetJobSettings(job);
+	current.inputs.resize(job.faces.size());
+
+	const Record* pStored = NULL;
+
+	{
+		lock_guard<mutex> l(m_mutex);
+
+		RecordMap::const_iterator it = m_records.find(job.output);
+
+		if (it != m_records.end())
+		{
+			pStored = &it->second;
+		}
+	}
+
+	bool upToDate = pStored && pStored->settings == current.settings && pStored->inputs.size() == current.inputs.size();
+
+	//the output was removed, edited or truncated since it was written
+	if (!StatFile(job.output, current.outputMtime, current.outputSize))
+	{
+		upToDate = false;
+	}
+	else if (pStored && (pStored->outputMtime != current.outputMtime || pStored->outputSize != current.outputSize))
+	{
+		upToDate = false;
+	}
+
+	for (size_t i = 0; i < job.faces.size(); i++)
+	{
+		Input& input = current.inputs[i];
+		input.path = job.faces[i];
+
+		//a missing input fails later while converting
+		if (!StatFile(input.path, input.mtime, input.size))
+		{
+			return false;
+		}
+
+		const Input* pOld = NULL;
+
+		if (pStored && i < pStored->inputs.size() && pStored->inputs[i].path == input.path)
+		{
+			pOld = &pStored->inputs[i];
+		}
+
+		//same file as before, no need to read it
+		if (pOld && pOld->mtime == input.mtime && pOld->size == input.size)
+		{
+			input.hash = pOld->hash;
+			continue;
+		}
+
+		Hash hash;
+
+		if (!hash.UpdateFile(input.path.c_str()))
+		{
+			return false;
+		}
+
+		input.hash = hash.GetHex();
+
+		//touched but the content is the same
+		if (!pOld || pOld->hash != input.hash)
+		{
+			upToDate = false;
+		}
+	}
+
+	return upToDate;
+}
+
+void DependencyDB::Check(const JobArray& jobs, JobArray& outdated)
+{
+	vector<Record> current(jobs.size());
+	vector<char> upToDate(jobs.size(), 0);
+
+	//stat and hash in parallel, the files are independent
+	ParallelFor(0, (int)jobs.size(), 1, [&](int first, int last)
+	{
+		for (int i = first; i < last; i++)
+		{
+			upToDate[i] = CheckJob(jobs[i], current[i]);
+		}
+	});
+
+	lock_guard<mutex> l(m_mutex);
+
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		if (upToDate[i])
+		{
+			//keeps the new mtimes of the touched files, avoids hashing them again
+			m_records[jobs[i].output] = current[i];
+			continue;
+		}
+
+		m_pending[jobs[i].output] = current[i];
+		outdated.push_back(jobs[i]);
+	}
+}
+
+void DependencyDB::Update(const Job& job)
+{
+	lock_guard<mutex> l(m_mutex);
+
+	RecordMap::iterator it = m_pending.find(job.output);
+
+	assert(it != m_pending.end());
+
+	if (it != m_pending.end())
+	{
+		//the output just written, the next Check compares against it
+		if (!StatFile(job.output, it->second.outputMtime, it->second.outputSize))
+		{
+			it->second.outputMtime = -1;
+		}
+
+		m_records[job.output] = it->second;
+		m_pending.erase(it);
+	}
+}
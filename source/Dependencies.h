@@ -0,0 +1,124 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __KTXTOOL_DEPENDENCIES_INCLUDED
+#define __KTXTOOL_DEPENDENCIES_INCLUDED
+
+
+
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <inttypes.h>
+#include "Job.h"
+
+
+
+
+
+/** Persistent database of the jobs already converted, (input path, mtime, size, 
+ *  content hash) of every face plus the settings and the output mtime and size
+ *  for each output. Used to only convert the jobs whose inputs or output changed
+ *  since the previous run. The content is only hashed when the mtime or size of
+ *  a file changed. */
+class DependencyDB
+{
+protected:
+
+	struct Input
+	{
+		std::string path;
+		int64_t     mtime;
+		uint64_t    size;
+		std::string hash;
+	};
+
+	struct Record
+	{
+		std::string        settings;
+		std::vector<Input> inputs;
+
+		/** The output as it was written, an edited or truncated one is outdated */
+		int64_t            outputMtime;
+		uint64_t           outputSize;
+
+		Record() : outputMtime(-1), outputSize(0) {}
+	};
+
+	/** By output path */
+	typedef std::map<std::string, Record> RecordMap;
+
+
+	std::string m_filePath;
+	RecordMap   m_records;
+
+	/** The current state of the outdated jobs, stored once they succeed */
+	RecordMap   m_pending;
+
+	std::mutex  m_mutex;
+
+
+	/** Fills the current state of a job inputs, reusing the stored hashes
+	 *  of the files that didn't change. Returns true if the job is up to date */
+	bool CheckJob(const Job& job, Record& current);
+
+public:
+
+
+	/** Loads the database, a missing file is just an empty database.
+	 *
+	 *  Returns false if the file exists but couldn't be read */
+	bool Load(const std::string& filePath);
+
+
+
+	/** Writes the database back to the file it was loaded from */
+	bool Save();
+
+
+
+	/** Checks all the jobs (concurrently), the ones whose inputs, settings or 
+	 *  output changed are added to outdated */
+	void Check(const JobArray& jobs, JobArray& outdated);
+
+
+
+	/** Records a job as converted, must have been returned by Check. The
+	 *  output is stat'ed here, so only once it has been written */
+	void Update(const Job& job);
+
+};
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+#endif
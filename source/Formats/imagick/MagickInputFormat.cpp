@@ -21,6 +21,7 @@
 
 #include "MagickInputFormat.h"
 #include <string.h>
+#include <stdlib.h>
 #include <ktxtool.h>
 #include <iostream>
 #include <PixelData.h>
@@ -56,10 +57,20 @@ static void DumpWandError(MagickWand* wand)
 
 
 
+static void TerminateMagick()
+{
+	MagickWandTerminus();
+}
+
 static int RegisterMagick()
 {
 	AddInputFormat(new MagickInputFormat);
 
+	//genesis/terminus are not thread safe, so they're called once per process
+	//allowing several faces to be decoded at the same time
+	MagickWandGenesis();
+	atexit(TerminateMagick);
+
 	return 0;
 }
 
@@ -72,12 +83,49 @@ bool MagickInputFormat::CheckExtension(const char* ext) const
 	return true;
 }
 
-PixelData* MagickInputFormat::CreatePixelData(const char* filePath)
+/** The sample type that keeps the depth of the image */
+static SampleType GetSampleType(MagickWand* wand)
+{
+	size_t depth = MagickGetImageDepth(wand);
+
+	if (depth <= 8)
+	{
+		return SAMPLE_UINT8;
+	}
+	else if (depth <= 16)
+	{
+		return SAMPLE_UINT16;
+	}
+
+	return SAMPLE_FLOAT;
+}
+
+bool MagickInputFormat::ReadInfo(const char* filePath, int& w, int& h, Format& format, SampleType& type)
+{
+	MagickWand* wand = NewMagickWand();
+
+	//only the attributes, the pixels are not read
+	if (MagickPingImage(wand, filePath) != MagickTrue)
+	{
+		DestroyMagickWand(wand);
+		return false;
+	}
+
+	w = MagickGetImageWidth(wand);
+	h = MagickGetImageHeight(wand);
+
+	format = MagickGetImageAlphaChannel(wand) == MagickFalse ? FORMAT_RGB : FORMAT_RGBA;
+	type = GetSampleType(wand);
+
+	DestroyMagickWand(wand);
+
+	return true;
+}
+
+PixelData* MagickInputFormat::CreatePixelData(const char* filePath, Arena* pArena)
 {
 	PixelData* pData = NULL;
 
-	
-	MagickWandGenesis();
 
 	MagickWand* wand = NewMagickWand();
 	MagickBooleanType status = MagickReadImage(wand, filePath);
@@ -86,7 +134,6 @@ PixelData* MagickInputFormat::CreatePixelData(const char* filePath)
 	{
 		DumpWandError(wand);
 		DestroyMagickWand(wand);
-		MagickWandTerminus();
 		return NULL;
 	}
 
@@ -105,10 +152,20 @@ PixelData* MagickInputFormat::CreatePixelData(const char* filePath)
 	assert(strFormat != NULL);
 
 
-	//Now create the pixel data
-	pData = new PixelData(w, h, format);
+	//Now create the pixel data, keeping the depth of the image
+	SampleType type = GetSampleType(wand);
+	StorageType storage = FloatPixel;
+
+	switch (type)
+	{
+	case SAMPLE_UINT8:  storage = CharPixel; break;
+	case SAMPLE_UINT16: storage = ShortPixel; break;
+	default:            storage = FloatPixel; type = SAMPLE_FLOAT; break;
+	}
 
-	status = MagickExportImagePixels(wand, 0, 0, w, h, strFormat,  FloatPixel, pData->GetData());
+	pData = new PixelData(w, h, format, type, pArena);
+
+	status = MagickExportImagePixels(wand, 0, 0, w, h, strFormat, storage, pData->GetData());
 
 	if (status != MagickTrue)
 	{
@@ -116,12 +173,10 @@ PixelData* MagickInputFormat::CreatePixelData(const char* filePath)
 
 		DumpWandError(wand);
 		DestroyMagickWand(wand);
-		MagickWandTerminus();
 		return NULL;
 	}
 
 	DestroyMagickWand(wand);
-	MagickWandTerminus();
 
 
 	return pData;
@@ -25,6 +25,7 @@
 #include <iostream>
 #include <PixelData.h>
 #include <fstream>
+#include <sstream>
 #include <vector>
 
 
@@ -57,109 +58,144 @@ bool PPMInputFormat::CheckExtension(const char* ext) const
 	return false;
 }
 
-PixelData* PPMInputFormat::CreatePixelData(const char* filePath)
+/** Reads the header, leaving the stream at the first pixel. Never throws, a malformed
+ * header just returns false */
+static bool ReadHeader(ifstream& ppm, int& w, int& h, float& maxval)
 {
-	PixelData* pData = nullptr;
-
-	int w = -1;
-	int h = -1;
-	float maxval = -1.f;
-
-	ifstream ppm(filePath);
-
-	//reads a line ignoring comments
-	auto ReadLine = [&]() -> string
+	//reads a line ignoring comments, false at the end of the file
+	auto ReadLine = [&](string& line) -> bool
 	{
-		string line;
-
-		while (!ppm.eof())
+		while (getline(ppm, line))
 		{
-			getline(ppm, line);
-
 			if (line.size() && line[0] != '#')
 			{
-				return line;
+				return true;
 			}
 		}
 
-		assert(false);
-		return line;
+		return false;
 	};
 
-	if (ReadLine() != "P3")
+	string line;
+
+	if (!ReadLine(line) || line != "P3")
 	{
 		cerr << "Invalid PPM format, failed to read the magick string" << endl;
-		ppm.close();
-		return NULL;
+		return false;
 	}
 
 	//read the dimmesion
-	string dimm = ReadLine();
-
-	size_t offset = dimm.find_first_of(' ');
+	if (!ReadLine(line))
+	{
+		cerr << "Invalid PPM format, unexpected end of file while reading the dimmension" << endl;
+		return false;
+	}
 
-	w = stoi(dimm.substr(0, offset));
-	h = stoi(dimm.substr(offset + 1, -1));
+	istringstream dimm(line);
 
-	if (w <= 0 && h <= 0)
+	if (!(dimm >> w >> h) || w <= 0 || h <= 0)
 	{
 		cerr << "Invalid PPM format, dimmension is invalid" << endl;
-		return NULL;
+		return false;
 	}
 
 
 	//read the maximum color value
-	maxval = stof(ReadLine());
+	if (!ReadLine(line))
+	{
+		cerr << "Invalid PPM format, unexpected end of file while reading the maximum color value" << endl;
+		return false;
+	}
+
+	istringstream value(line);
 
-	if (maxval > 65536.0 || maxval <= 0.f)
+	if (!(value >> maxval) || maxval > 65536.0 || maxval <= 0.f)
 	{
 		cerr << "Invalid PPM format, the maximuym color value is invalid" << endl;
-		return NULL;
+		return false;
 	}
-	
-	//read pixel data
-	pData = new PixelData(w, h, FORMAT_RGB);
 
-	int i = 0;
+	return true;
+}
 
-	//fixes the row order to match the standards
-	auto GetIndex = [&]() -> int
+bool PPMInputFormat::ReadInfo(const char* filePath, int& w, int& h, Format& format, SampleType& type)
+{
+	float maxval;
+
+	ifstream ppm(filePath);
+
+	if (!ppm.is_open() || !ReadHeader(ppm, w, h, maxval))
 	{
-		//Removed, suspected as a bug	
-		/*int x = i % w;
-		int y = (i - x) / w;
-		return ((w * h) - ((y * w) + (w - x))) * 3;*/
+		return false;
+	}
 
-		return i * 3;
-	};
-	
-	while (i < pData->GetPixelCount())
+	format = FORMAT_RGB;
+	type = maxval > 255.f ? SAMPLE_UINT16 : SAMPLE_UINT8;
+
+	return true;
+}
+
+PixelData* PPMInputFormat::CreatePixelData(const char* filePath, Arena* pArena)
+{
+	PixelData* pData = nullptr;
+
+	int w = -1;
+	int h = -1;
+	float maxval = -1.f;
+
+	ifstream ppm(filePath);
+
+	if (!ReadHeader(ppm, w, h, maxval))
 	{
-		if (ppm.eof()) break;
+		ppm.close();
+		return NULL;
+	}
+	
+	//read pixel data, 8 bit unless the maxval needs more
+	const bool wide = maxval > 255.f;
+
+	pData = new PixelData(w, h, FORMAT_RGB, wide ? SAMPLE_UINT16 : SAMPLE_UINT8, pArena);
+
+	const float scale = (wide ? 65535.f : 255.f) / maxval;
 
-		float* pixel = &pData->Get(GetIndex());
+	uint8_t* pSamples8 = wide ? NULL : pData->GetSamples<uint8_t>();
+	uint16_t* pSamples16 = wide ? pData->GetSamples<uint16_t>() : NULL;
 
-		//Read a pixel component and normalizes it
-		auto ReadComp = [&]() -> float
+	int i = 0;
+
+	while (i < pData->GetPixelCount())
+	{
+		//Read a pixel component and normalizes it to the sample range
+		auto ReadComp = [&]() -> int
 		{
-			float comp;
+			int comp = 0;
 
 			ppm >> comp;
 
-			return comp / maxval;
+			return (int)(comp * scale + 0.5f);
 		};
 
-		pixel[0] = ReadComp();
-		pixel[1] = ReadComp();
-		pixel[2] = ReadComp();
+		for (int c = 0; c < 3; c++)
+		{
+			if (wide)
+			{
+				pSamples16[i * 3 + c] = ReadComp();
+			}
+			else
+			{
+				pSamples8[i * 3 + c] = ReadComp();
+			}
+		}
+
+		//truncated or not a number
+		if (ppm.fail()) break;
 				
 		i++;
 	}
 
-	assert(i == pData->GetPixelCount());
 	if (i != pData->GetPixelCount())
 	{
-		cerr << "Invalid PPM format, unexpected end of file while reading pixels" << endl;
+		cerr << "Invalid PPM format, unexpected end of file or invalid value while reading pixels" << endl;
 		delete pData;
 		return NULL;
 	}
@@ -25,6 +25,7 @@
 #include <ktxtool.h>
 #include <iostream>
 #include <PixelData.h>
+#include <Parallel.h>
 #include <fstream>
 
 
@@ -57,7 +58,33 @@ bool TIFFInputFormat::CheckExtension(const char* ext) const
 	return false;
 }
 
-PixelData* TIFFInputFormat::CreatePixelData(const char* filePath)
+bool TIFFInputFormat::ReadInfo(const char* filePath, int& w, int& h, Format& format, SampleType& type)
+{
+	TIFF* tif = TIFFOpen(filePath, "r");
+
+	if (tif == nullptr)
+	{
+		return false;
+	}
+
+	uint32 tw = 0, th = 0;
+
+	TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &tw);
+	TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &th);
+
+	TIFFClose(tif);
+
+	w = tw;
+	h = th;
+
+	//always read as RGBA 8 bit
+	format = FORMAT_RGBA;
+	type = SAMPLE_UINT8;
+
+	return w > 0 && h > 0;
+}
+
+PixelData* TIFFInputFormat::CreatePixelData(const char* filePath, Arena* pArena)
 {
 	PixelData* pData = nullptr;
 
@@ -78,40 +105,57 @@ PixelData* TIFFInputFormat::CreatePixelData(const char* filePath)
 
 		//cout << "Creating pixel data from TIFF Image " << w << " x " << h << " px" << endl;
 
-		raster = (uint32*) _TIFFmalloc(npixels * sizeof (uint32));
+		//this allocates the internal pixel buffer	
+		pData = new PixelData(w, h, FORMAT_RGBA, SAMPLE_UINT8, pArena);
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+		//the packed ABGR raster is already RGBA in memory, read it right into the pixel data
+		raster = (uint32*)pData->GetData();
 
-		if (raster != nullptr) 
+		if (!TIFFReadRGBAImageOriented(tif, w, h, raster, ORIENTATION_TOPLEFT, 0))
 		{
-			if (TIFFReadRGBAImageOriented(tif, w, h, raster, ORIENTATION_TOPLEFT, 0))
-			{
-				//this allocates the internal pixel buffer	
-				pData = new PixelData(w, h, FORMAT_RGBA);
+			delete pData;
+			pData = nullptr;
+		}
+
+#else
+
+		raster = (uint32*) _TIFFmalloc(npixels * sizeof (uint32));
 
+		if (raster != nullptr && TIFFReadRGBAImageOriented(tif, w, h, raster, ORIENTATION_TOPLEFT, 0))
+		{
+			uint8_t* pSamples = pData->GetSamples<uint8_t>();
 
-				for (size_t i = 0; i < npixels; i++)
+			ParallelFor(0, npixels, 1 << 14, [&](int first, int last)
+			{
+				for (int i = first; i < last; i++)
 				{
 					uint32& packed = raster[i];
 					
 
-					float* pixel = pData->GetPixel(i);
+					uint8_t* pixel = pSamples + i * 4;
 							
 					pixel[0] = TIFFGetR(packed);
 					pixel[1] = TIFFGetG(packed);
 					pixel[2] = TIFFGetB(packed);
 					pixel[3] = TIFFGetA(packed);
-					
-					pixel[0] /= 255.f;
-					pixel[1] /= 255.f;
-					pixel[2] /= 255.f;
-					pixel[3] /= 255.f;
 				}
+			});
+		}
+		else
+		{
+			delete pData;
+			pData = nullptr;
+		}
 
-
-
-			}
+		if (raster != nullptr)
+		{
 			_TIFFfree(raster);
 		}
 
+#endif
+
 		TIFFClose(tif);
 	}
 
@@ -29,6 +29,7 @@
 
 
 class PixelData;
+class Arena;
 
 
 
@@ -42,7 +43,9 @@ public:
 
 	bool CheckExtension(const char* ext) const;
 
-	PixelData* CreatePixelData(const char* filePath);
+	PixelData* CreatePixelData(const char* filePath, Arena* pArena);
+
+	bool ReadInfo(const char* filePath, int& w, int& h, Format& format, SampleType& type);
 
 	const char* GetName() const { return "TIFF - Tagged Image File Format"; }
 
@@ -0,0 +1,187 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include "Hash.h"
+#include <string.h>
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+
+
+
+
+
+using namespace std;
+
+
+
+
+
+static inline uint64_t Rotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+/** Final avalanche, from MurmurHash3 */
+static inline uint64_t Fmix(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+
+	return k;
+}
+
+Hash::Hash()
+{
+	m_h1 = 0x9e3779b97f4a7c15ULL;
+	m_h2 = 0x6a09e667f3bcc909ULL;
+	m_length = 0;
+	m_tailSize = 0;
+}
+
+void Hash::MixWord(uint64_t word)
+{
+	m_h1 ^= Rotl(word * 0x87c37b91114253d5ULL, 31) * 0x4cf5ad432745937fULL;
+	m_h1 = Rotl(m_h1, 27) + m_h2;
+	m_h1 = m_h1 * 5 + 0x52dce729;
+
+	m_h2 ^= Rotl(word * 0x4cf5ad432745937fULL, 33) * 0x87c37b91114253d5ULL;
+	m_h2 = Rotl(m_h2, 31) + m_h1;
+	m_h2 = m_h2 * 5 + 0x38495ab5;
+}
+
+void Hash::Update(const void* pData, size_t size)
+{
+	const uint8_t* p = (const uint8_t*)pData;
+
+	m_length += size;
+
+	//complete the pending word first
+	if (m_tailSize > 0)
+	{
+		size_t count = min(size, 8 - m_tailSize);
+
+		memcpy(m_tail + m_tailSize, p, count);
+
+		m_tailSize += count;
+		p += count;
+		size -= count;
+
+		if (m_tailSize == 8)
+		{
+			uint64_t word;
+			memcpy(&word, m_tail, 8);
+
+			MixWord(word);
+			m_tailSize = 0;
+		}
+	}
+
+	while (size >= 8)
+	{
+		uint64_t word;
+		memcpy(&word, p, 8);
+
+		MixWord(word);
+
+		p += 8;
+		size -= 8;
+	}
+
+	//less than a word is left, the tail is empty here
+	if (size > 0)
+	{
+		memcpy(m_tail, p, size & 7);
+		m_tailSize = size & 7;
+	}
+}
+
+void Hash::Update(const string& str)
+{
+	Update((uint64_t)str.size());
+	Update(str.data(), str.size());
+}
+
+void Hash::Update(uint64_t value)
+{
+	Update(&value, sizeof(value));
+}
+
+bool Hash::UpdateFile(const char* filePath)
+{
+	FILE* file = fopen(filePath, "rb");
+
+	if (!file)
+	{
+		return false;
+	}
+
+	vector<char> buffer(1 << 20);
+
+	size_t read;
+
+	while ((read = fread(&buffer[0], 1, buffer.size(), file)) > 0)
+	{
+		Update(&buffer[0], read);
+	}
+
+	bool failed = ferror(file) != 0;
+
+	fclose(file);
+
+	return !failed;
+}
+
+string Hash::GetHex() const
+{
+	uint64_t h1 = m_h1;
+	uint64_t h2 = m_h2;
+
+	//the pending bytes, zero padded
+	if (m_tailSize > 0)
+	{
+		uint64_t word = 0;
+		memcpy(&word, m_tail, m_tailSize);
+
+		h1 ^= Rotl(word * 0x87c37b91114253d5ULL, 31) * 0x4cf5ad432745937fULL;
+		h2 ^= Rotl(word * 0x4cf5ad432745937fULL, 33) * 0x87c37b91114253d5ULL;
+	}
+
+	h1 ^= m_length;
+	h2 ^= m_length;
+
+	h1 += h2;
+	h2 += h1;
+
+	h1 = Fmix(h1);
+	h2 = Fmix(h2);
+
+	h1 += h2;
+	h2 += h1;
+
+	char hex[33];
+	snprintf(hex, sizeof(hex), "%016llx%016llx", (unsigned long long)h1, (unsigned long long)h2);
+
+	return hex;
+}
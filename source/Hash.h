@@ -0,0 +1,96 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __KTXTOOL_HASH_INCLUDED
+#define __KTXTOOL_HASH_INCLUDED
+
+
+
+
+#include <string>
+#include <inttypes.h>
+
+
+
+
+
+/** 128bit non cryptographic hash, used to identify file contents and settings.
+ *  The data can be added in several steps, the result only depends on the 
+ *  bytes added and their order. */
+class Hash
+{
+protected:
+
+	uint64_t m_h1;
+	uint64_t m_h2;
+	uint64_t m_length;
+
+	uint8_t  m_tail[8];
+	size_t   m_tailSize;
+
+
+	void MixWord(uint64_t word);
+
+public:
+
+
+	Hash();
+
+
+
+	/** Adds raw data to the hash */
+	void Update(const void* pData, size_t size);
+
+
+
+	/** Adds a string, its length is included so "ab","c" differs from "a","bc" */
+	void Update(const std::string& str);
+
+
+
+	/** Adds an integer value */
+	void Update(uint64_t value);
+
+
+
+	/** Adds the whole content of a file. Returns false if it couldn't be read */
+	bool UpdateFile(const char* filePath);
+
+
+
+	/** The hash of the data added so far as 32 hex characters */
+	std::string GetHex() const;
+
+};
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+#ifndef __KTXTOOL_IMAGEVIEW_INCLUDED
+#define __KTXTOOL_IMAGEVIEW_INCLUDED
+
+
+
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <assert.h>
+
+
+
+
+
+/** Non owning view of an image in memory, a base pointer to the first row
+ *  and the strides in bytes to the next row and pixel. The row stride might
+ *  be negative, then the rows go up in memory (bottom-up images), so a flip
+ *  or a sub-rectangle is just another view of the same pixels. Kernels walk
+ *  the rows with Row(y) and step the pixels with the pixel stride. */
+struct ImageView
+{
+	uint8_t*  pData;
+	int       w;
+	int       h;
+	ptrdiff_t rowStride;
+	int       pixelStride;
+
+
+	inline ImageView()
+	{
+		pData = nullptr;
+		w = 0;
+		h = 0;
+		rowStride = 0;
+		pixelStride = 0;
+	}
+
+	/** Tightly packed rows, top-down */
+	inline ImageView(void* _pData, int _w, int _h, int _pixelStride)
+	{
+		pData = (uint8_t*)_pData;
+		w = _w;
+		h = _h;
+		pixelStride = _pixelStride;
+		rowStride = (ptrdiff_t)_w * _pixelStride;
+	}
+
+	inline uint8_t* Row(int y) const
+	{
+		assert(y >= 0 && y < h);
+
+		return pData + y * rowStride;
+	}
+
+	inline uint8_t* At(int x, int y) const
+	{
+		assert(x >= 0 && x < w);
+
+		return Row(y) + x * pixelStride;
+	}
+
+	/** The same pixels upside down */
+	inline ImageView FlipY() const
+	{
+		ImageView view = *this;
+
+		if (h > 0)
+		{
+			view.pData = pData + (h - 1) * rowStride;
+		}
+
+		view.rowStride = -rowStride;
+
+		return view;
+	}
+
+	/** The rectangle at x, y of size sw x sh, which must be inside */
+	inline ImageView Sub(int x, int y, int sw, int sh) const
+	{
+		assert(x >= 0 && y >= 0 && x + sw <= w && y + sh <= h);
+
+		ImageView view = *this;
+
+		view.pData = pData + y * rowStride + x * pixelStride;
+		view.w = sw;
+		view.h = sh;
+
+		return view;
+	}
+
+	/** Packed top-down rows, a row can be copied at once */
+	inline bool IsContiguous() const
+	{
+		return rowStride == (ptrdiff_t)w * pixelStride;
+	}
+};
+
+
+
+
+
+
+
+
+
+#endif
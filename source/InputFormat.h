@@ -25,7 +25,13 @@
 
 
 
+#include <stddef.h>
+#include <Types.h>
+
+
+
 class PixelData;
+class Arena;
 
 
 
@@ -50,10 +56,22 @@ public:
 
 
 
-	/** Creates a new pixel data object from the file path provided.
+	/** Creates a new pixel data object from the file path provided, the
+	 *  samples are allocated from the arena if any.
 	 *
 	 *  return NULL if failed */
-	virtual PixelData* CreatePixelData(const char* filePath) = 0;
+	virtual PixelData* CreatePixelData(const char* filePath, Arena* pArena = NULL) = 0;
+
+
+
+
+
+	/** Reads the dimmension, format and sample type of the file without
+	 *  decoding the pixels, used to estimate the cost of a job.
+	 *
+	 *  return false if failed or not supported by the format, it must not
+	 *  throw: a malformed file only fails its own job when it is decoded */
+	virtual bool ReadInfo(const char* filePath, int& w, int& h, Format& format, SampleType& type) { return false; }
 
 
 
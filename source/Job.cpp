@@ -0,0 +1,572 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include "Job.h"
+#include "ktxtool.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <assert.h>
+#include <functional>
+#include <exception>
+#include <stdio.h>
+#include <errno.h>
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "InputFormat.h"
+#include "PixelData.h"
+#include "Parallel.h"
+#include "Hash.h"
+#include "Cache.h"
+#include "ktx/Container.h"
+
+#include "ktx/Compression/Compression.h"
+#include "ktx/Compression/ETC1/ETC1.h"
+
+
+
+
+
+/** Bump this when the same inputs and settings produce a different output,
+ *  so the cached outputs of older builds aren't used */
+#define JOB_OUTPUT_VERSION 8
+
+
+
+
+
+using namespace std;
+
+
+
+
+
+static bool FileExists(const string& filePath)
+{
+	ifstream file(filePath.c_str());
+
+	if (file.good())
+	{
+		file.close();
+		return true;
+	}
+
+	file.close();
+	return false;
+}
+
+void SetJobFiles(Job& job, const string& input, const string& output)
+{
+	job.faces.clear();
+
+	std::istringstream ss(input);
+	std::string token;
+
+	//extract the filenames as faces
+	while (std::getline(ss, token, ','))
+	{
+		job.faces.push_back(token);
+	}
+
+	job.output = output;
+
+	if (job.output.size() == 0 && job.faces.size() > 0)
+	{
+		size_t dotAt = job.faces[0].find_last_of('.');
+
+		job.output = job.faces[0].substr(0, dotAt);
+		job.output += ".ktx";
+	}
+}
+
+string GetJobSettings(const Job& job)
+{
+	std::ostringstream ss;
+
+	ss << "v=" << KTXTOOL_VERSION << "." << JOB_OUTPUT_VERSION;
+	ss << " c=" << job.compress;
+	ss << " q=" << job.quality;
+	ss << " y=" << job.flipY;
+	ss << " cs=" << job.colorTransform;
+	ss << " pm=" << job.premultiply;
+	ss << " mf=" << job.mipFilter;
+
+	return ss.str();
+}
+
+/** Identifies everything that determines the output of the job: the content
+ *  of the faces and the settings */
+static bool ComputeCacheKey(const Job& job, string& key)
+{
+	Hash hash;
+
+	hash.Update(GetJobSettings(job));
+
+	hash.Update((uint64_t)job.faces.size());
+
+	for (size_t i = 0; i < job.faces.size(); i++)
+	{
+		if (!hash.UpdateFile(job.faces[i].c_str()))
+		{
+			return false;
+		}
+	}
+
+	key = hash.GetHex();
+
+	return true;
+}
+
+/** Runs fn(i) for every face index at the same time, returns once all of them are done */
+static void ForEachFace(size_t count, const function<void(size_t)>& fn)
+{
+	ParallelFor(0, (int)count, 1, [&](int first, int last)
+	{
+		for (int i = first; i < last; i++)
+		{
+			fn(i);
+		}
+	});
+}
+
+JobData::JobData(Job* _pJob, OutputCache* _pCache)
+{
+	pJob = _pJob;
+	pCache = _pCache;
+	error = 0;
+	done = false;
+	memory = 0;
+	pArena = nullptr;
+}
+
+JobData::~JobData()
+{
+	DeletePixels();
+}
+
+void JobData::DeletePixels()
+{
+	pixels.clear();
+}
+
+int DecodeJob(JobData& data)
+{
+	const Job::StringArray& faces = data.pJob->faces;
+
+	if (faces.size() == 0)
+	{
+		cerr << "No input files defined" << endl;
+		return data.error = 7;
+	}
+
+
+	//lookup the formats first so the decoding doesn't start for nothing
+	vector<InputFormat*> faceFormats(faces.size(), nullptr);
+
+	for (size_t i = 0; i < faces.size(); i++)
+	{
+		const string& fileName = faces[i];
+
+		cout << "Processing face at index " << i << ": " << fileName << endl;
+
+		//check if the file exists
+		if (!FileExists(fileName))
+		{
+			cerr << "Input file  doesn't exist" << endl;
+			return data.error = 7;
+		}
+
+		if (fileName.find_last_of('.') == string::npos)
+		{
+			cerr << "Input file has no extension, therefore unabled to determine its format" << endl;
+			return data.error = 10;
+		}
+
+		//Lookup for a compatible format
+		faceFormats[i] = FindInputFormat(fileName);
+
+		if (faceFormats[i] == nullptr)
+		{
+			cerr << "Input format is not supported" << endl;
+			return data.error = 8;
+		}
+	}
+
+
+	//the same inputs and settings were converted before
+	if (data.pCache && ComputeCacheKey(*data.pJob, data.cacheKey))
+	{
+		if (data.pCache->Fetch(data.cacheKey, data.pJob->output))
+		{
+			cout << "Taken from cache " << data.pJob->output << endl;
+
+			data.done = true;
+			return 0;
+		}
+	}
+
+
+	//decode all the faces concurrently
+	vector<unique_ptr<PixelData> >& pixels = data.pixels;
+
+	pixels.clear();
+	pixels.resize(faces.size());
+
+	ForEachFace(faces.size(), [&](size_t i)
+	{
+		assert(faceFormats[i] != nullptr);
+
+		//a malformed file must fail its own job only, not the whole batch. Only
+		//the 8-bit faces take the arena, see PixelData
+		try
+		{
+			pixels[i].reset(faceFormats[i]->CreatePixelData(faces[i].c_str(), data.pArena));
+		}
+		catch (const exception& e)
+		{
+			cerr << "Error decoding " << faces[i] << ": " << e.what() << endl;
+		}
+		catch (...)
+		{
+			cerr << "Error decoding " << faces[i] << endl;
+		}
+	});
+
+	for (size_t i = 0; i < pixels.size(); i++)
+	{
+		if (pixels[i] == nullptr)
+		{
+			data.DeletePixels();
+
+			cerr << "Couldn't create pixel data from input file " << faces[i] << endl;
+			return data.error = 11;
+		}
+	}
+
+	return 0;
+}
+
+int ConvertJob(JobData& data)
+{
+	Job& job = *data.pJob;
+	Container& ktx = data.ktx;
+	vector<unique_ptr<PixelData> >& pixels = data.pixels;
+
+	assert(data.error == 0 && pixels.size() > 0);
+
+
+	//all faces should match this format, width and height (taken from index 0)
+	const int    refWidth = pixels[0]->GetWidth();
+	const int    refHeight = pixels[0]->GetHeight();
+	const Format refFormat = pixels[0]->GetFormat();
+
+	for (size_t i = 1; i < pixels.size(); i++)
+	{
+		if (!(refFormat == pixels[i]->GetFormat() && refWidth == pixels[i]->GetWidth() && refHeight == pixels[i]->GetHeight()))
+		{
+			data.DeletePixels();
+
+			cerr << "Format/Dimmension mismatch, all faces should match the face at index 0" << endl;
+			return data.error = 15;
+		}
+	}
+
+
+	Compression* pComp = nullptr;
+
+	if (job.compress)
+	{
+		pComp = new ETC1();
+		pComp->SetQuality(job.quality);
+	}
+
+	ktx.SetArena(data.pArena);
+	ktx.SetMipFilter(job.mipFilter);
+	ktx.Init(refWidth, refHeight, 1, pixels.size());
+	ktx.SetFormat(refFormat, COLOR_DEPTH_8BIT, pComp);
+	ktx.SetColorConversion(job.colorTransform, job.premultiply);
+
+
+	job.pixelCount = 0;
+
+	for (size_t i = 0; i < pixels.size(); i++)
+	{
+		job.pixelCount += pixels[i]->GetPixelCount();
+	}
+
+	//the faces are handed to the container, 8-bit ones without a copy
+	ForEachFace(pixels.size(), [&](size_t i)
+	{
+		ktx.SetData(0, i, std::move(*pixels[i]), job.flipY);
+	});
+
+	data.DeletePixels();
+
+
+	ktx.GenerateMipmaps(job.dumpMipmaps);
+
+	return 0;
+}
+
+int EncodeJob(JobData& data)
+{
+	assert(data.error == 0);
+
+	data.ktx.Encode();
+
+	return 0;
+}
+
+int WriteJob(JobData& data)
+{
+	assert(data.error == 0);
+
+	const string& output = data.pJob->output;
+
+	//written next to the output and renamed over it, so a failed write keeps the
+	//previous output and an output hardlinked to a cache entry is replaced, not modified
+	const string temp = output + ".tmp";
+
+	if (!data.ktx.Write(temp.c_str()))
+	{
+		remove(temp.c_str());
+		return data.error = 12;
+	}
+
+	if (rename(temp.c_str(), output.c_str()) != 0)
+	{
+		cerr << "Couldn't rename " << temp << " to " << output << ": " << strerror(errno) << endl;
+		remove(temp.c_str());
+		return data.error = 12;
+	}
+
+	//the final path, the temporary file is an implementation detail
+	cout << "Writing ktx container to " << output << endl;
+
+	if (data.pCache && data.cacheKey.size())
+	{
+		data.pCache->Store(data.cacheKey, output);
+	}
+
+	return 0;
+}
+
+int RunJob(Job& job, OutputCache* pCache)
+{
+	JobData data(&job, pCache);
+
+	if (DecodeJob(data) || data.done)
+	{
+		return data.error;
+	}
+
+	if (ConvertJob(data) || EncodeJob(data) || WriteJob(data))
+	{
+		return data.error;
+	}
+
+	return 0;
+}
+
+bool ReadManifest(const char* filePath, const Job& defaults, JobArray& jobs)
+{
+	ifstream manifest(filePath);
+
+	if (!manifest.is_open())
+	{
+		cerr << "Couldn't open manifest '" << filePath << "'" << endl;
+		return false;
+	}
+
+	string line;
+	int lineNumber = 0;
+
+	while (getline(manifest, line))
+	{
+		lineNumber++;
+
+		std::istringstream ss(line);
+		std::string token;
+
+		vector<string> files;
+		Job job = defaults;
+
+		while (ss >> token)
+		{
+			if (files.size() == 0 && token[0] == '#')
+			{
+				break;
+			}
+
+			//the job options, the same as in the command line
+			if (files.size() == 0 && token.size() == 2 && token[0] == '-')
+			{
+				switch (token[1])
+				{
+				case 'c': job.compress = true; break;
+				case 'y': job.flipY = true; break;
+				case 'd': job.dumpMipmaps = true; break;
+				case 'p': job.premultiply = true; break;
+				case 'l': job.colorTransform = COLOR_TRANSFORM_SRGB_TO_LINEAR; break;
+				case 'g': job.colorTransform = COLOR_TRANSFORM_LINEAR_TO_SRGB; break;
+				default:
+					cerr << filePath << ":" << lineNumber << ": Unrecongized job option " << token << endl;
+					return false;
+				}
+
+				continue;
+			}
+
+			files.push_back(token);
+		}
+
+		//empty line or comment
+		if (files.size() == 0)
+		{
+			continue;
+		}
+
+		if (files.size() > 2)
+		{
+			cerr << filePath << ":" << lineNumber << ": Unexpected '" << files[2] << "', expected FILEIN [FILEOUT]" << endl;
+			return false;
+		}
+
+		SetJobFiles(job, files[0], files.size() > 1 ? files[1] : string());
+
+		jobs.push_back(job);
+	}
+
+	return true;
+}
+
+static bool MakeDirectory(const string& dir)
+{
+	return mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+/** Whether the extension is an image one. A source tree has other files too
+ *  (ie. the .ktx outputs or text files) and some decoders accept anything */
+static bool IsImageFile(const string& name)
+{
+	static const char* extensions[] =
+	{
+		"bmp", "exr", "gif", "hdr", "jpeg", "jpg", "pbm", "pgm", "png",
+		"ppm", "psd", "tga", "tif", "tiff", "webp"
+	};
+
+	size_t dotAt = name.find_last_of('.');
+
+	if (dotAt == string::npos)
+	{
+		return false;
+	}
+
+	string ext = name.substr(dotAt + 1);
+
+	transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+	for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+	{
+		if (ext == extensions[i])
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ReadSourceTree(const string& srcDir, const string& outDir, const Job& settings, JobArray& jobs)
+{
+	DIR* pDir = opendir(srcDir.c_str());
+
+	if (!pDir)
+	{
+		cerr << "Couldn't read the source directory '" << srcDir << "'" << endl;
+		return false;
+	}
+
+	if (!MakeDirectory(outDir))
+	{
+		closedir(pDir);
+
+		cerr << "Couldn't create the output directory '" << outDir << "'" << endl;
+		return false;
+	}
+
+	//sorted so the jobs order doesn't depend on the file system
+	vector<string> names;
+
+	while (dirent* pEntry = readdir(pDir))
+	{
+		string name = pEntry->d_name;
+
+		if (name != "." && name != "..")
+		{
+			names.push_back(name);
+		}
+	}
+
+	closedir(pDir);
+
+	sort(names.begin(), names.end());
+
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		const string srcPath = srcDir + "/" + names[i];
+
+		struct stat st;
+
+		if (stat(srcPath.c_str(), &st) != 0)
+		{
+			continue;
+		}
+
+		if (S_ISDIR(st.st_mode))
+		{
+			if (!ReadSourceTree(srcPath, outDir + "/" + names[i], settings, jobs))
+			{
+				return false;
+			}
+
+			continue;
+		}
+
+		if (!S_ISREG(st.st_mode) || !IsImageFile(names[i]) || FindInputFormat(names[i]) == NULL)
+		{
+			continue;
+		}
+
+		Job job = settings;
+
+		size_t dotAt = names[i].find_last_of('.');
+
+		SetJobFiles(job, srcPath, outDir + "/" + names[i].substr(0, dotAt) + ".ktx");
+
+		jobs.push_back(job);
+	}
+
+	return true;
+}
@@ -0,0 +1,218 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __KTXTOOL_JOB_INCLUDED
+#define __KTXTOOL_JOB_INCLUDED
+
+
+
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <inttypes.h>
+#include "ktx/Container.h"
+#include "ktx/Compression/Compression.h"
+
+
+
+
+
+/** A single conversion, one or several input faces into one ktx container.
+ *  Jobs come either from the command line or from a manifest file. */
+struct Job
+{
+	typedef std::vector<std::string> StringArray;
+
+	StringArray faces;
+	std::string output;
+
+	bool        compress;
+	bool        flipY;
+	bool        dumpMipmaps;
+
+	Compression::Quality quality;
+
+	/** Colour conversion done along with the 8-bit conversion */
+	ColorTransform colorTransform;
+	bool        premultiply;
+
+	MipFilter   mipFilter;
+
+
+	/** Filled by RunJob, the amount of source pixels (all faces) converted */
+	uint64_t    pixelCount;
+
+	/** Filled by RunBatch, the error code of the job, zero if succeeded */
+	int         result;
+
+	Job()
+	{
+		compress = false;
+		flipY = false;
+		dumpMipmaps = false;
+		quality = Compression::QUALITY_HIGH;
+		colorTransform = COLOR_TRANSFORM_NONE;
+		premultiply = false;
+		mipFilter = MIP_FILTER_BOX;
+		pixelCount = 0;
+		result = 0;
+	}
+};
+
+
+typedef std::vector<Job> JobArray;
+
+
+
+
+class PixelData;
+class OutputCache;
+class Arena;
+
+
+/** The intermediate data of a job while it goes through the stages,
+ *  Decode -> Convert -> Encode -> Write */
+struct JobData
+{
+	Job*                    pJob;
+
+	std::vector<std::unique_ptr<PixelData> > pixels;
+	Container               ktx;
+
+	/** Error code of the stage that failed, zero if none */
+	int                     error;
+
+	/** The job finished early (ie. the output was taken from the cache) 
+	 *  and the following stages must be skipped */
+	bool                    done;
+
+	/** Optional output cache, the key identifies the inputs and settings */
+	OutputCache*            pCache;
+	std::string             cacheKey;
+
+	/** Bytes reserved for the job in the batch memory budget */
+	uint64_t                memory;
+
+	/** Optional, the image buffers are allocated from here instead of the 
+	 *  heap. Must be reset only after the job data is deleted */
+	Arena*                  pArena;
+
+
+	JobData(Job* pJob, OutputCache* pCache = NULL);
+	~JobData();
+
+	void DeletePixels();
+
+private:
+
+	JobData(const JobData&);
+	JobData& operator=(const JobData&);
+};
+
+
+
+
+/** Splits the comma separated input files into the job faces and
+ *  sets the output file, derived from the first face if empty */
+void SetJobFiles(Job& job, const std::string& input, const std::string& output);
+
+
+
+
+/** Returns the settings that change the output of a job (including the tool 
+ *  version) as a string, the same settings give the same string */
+std::string GetJobSettings(const Job& job);
+
+
+
+
+/** Checks the input files and decodes all the faces concurrently. If there's
+ *  a cache and it has the output already it's used instead and the job is done
+ *
+ *  Returns zero if succeeded, otherwise the error code (also set in data.error) */
+int DecodeJob(JobData& data);
+
+
+
+
+/** Validates the faces against the face at index 0, converts them into the 
+ *  container and generates the mipmaps. The decoded pixels are freed. 
+ *
+ *  Returns zero if succeeded, otherwise the error code (also set in data.error) */
+int ConvertJob(JobData& data);
+
+
+
+
+/** Compresses the container, if the job has compression */
+int EncodeJob(JobData& data);
+
+
+
+
+/** Writes the container to the job output file, and stores it in the cache */
+int WriteJob(JobData& data);
+
+
+
+
+/** Runs a job, all the stages one after the other. The cache is optional.
+ *
+ *  Returns zero if succeeded, otherwise the error code */
+int RunJob(Job& job, OutputCache* pCache = NULL);
+
+
+
+
+/** Reads a manifest file, one job per line using the same syntax as the
+ *  command line, ie. [-c] [-y] [-d] [-p] [-l|-g] face1.ppm[,face2.ppm...] [out.ktx]
+ *  Every job starts with the settings of the defaults job (the command line 
+ *  options), the options of the line are added to them. Empty lines and lines
+ *  starting with # are ignored.
+ *
+ *  Returns false if the file couldn't be read or has an invalid line */
+bool ReadManifest(const char* filePath, const Job& defaults, JobArray& jobs);
+
+
+
+
+/** Creates a job for every file with a supported format in the source directory
+ *  (recursively), the output keeps the same relative path in the output directory
+ *  with the ktx extension. The output subdirectories are created and the settings
+ *  (compression, flip...) are copied from the job provided.
+ *
+ *  Returns false if the source directory couldn't be read */
+bool ReadSourceTree(const std::string& srcDir, const std::string& outDir, const Job& settings, JobArray& jobs);
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+#endif
@@ -0,0 +1,477 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include "Parallel.h"
+#include <assert.h>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <memory>
+
+#ifdef KTXTOOL_TBB
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/global_control.h>
+
+using namespace tbb;
+
+#endif
+
+
+
+
+
+using namespace std;
+
+
+
+
+
+static int threadCount = 0;
+
+
+#ifdef KTXTOOL_TBB
+
+
+static unique_ptr<global_control> pControl;
+
+
+void SetThreadCount(int count)
+{
+	threadCount = count;
+
+	pControl.reset();
+
+	if (count > 0)
+	{
+		pControl.reset(new global_control(global_control::max_allowed_parallelism, count));
+	}
+}
+
+int GetThreadCount()
+{
+	return (int)global_control::active_value(global_control::max_allowed_parallelism);
+}
+
+void ParallelFor(int first, int last, int grain, const function<void(int, int)>& fn)
+{
+	if (last <= first)
+	{
+		return;
+	}
+
+	parallel_for(blocked_range<int>(first, last, max(1, grain)), [&](const blocked_range<int>& r)
+	{
+		fn(r.begin(), r.end());
+	});
+}
+
+TaskGroup::TaskGroup()
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+	WaitPending();
+}
+
+void TaskGroup::Run(const Task& task)
+{
+	m_group.run(task);
+}
+
+void TaskGroup::Wait()
+{
+	//tbb already rethrows the exception of a task
+	m_group.wait();
+}
+
+void TaskGroup::WaitPending()
+{
+	try
+	{
+		m_group.wait();
+	}
+	catch (...)
+	{
+	}
+}
+
+void TaskGroup::Done()
+{
+}
+
+void TaskGroup::Execute(const function<void()>& task)
+{
+	task();
+}
+
+
+#else
+
+
+/** Work stealing pool, each worker has its own deque where it pushes and pops
+ *  the tasks it spawns (LIFO), idle workers steal from the other end (FIFO).
+ *  Tasks issued by threads outside the pool go into a shared queue. */
+class ThreadPool
+{
+	struct Task
+	{
+		TaskGroup::Task fn;
+		TaskGroup*      pGroup;
+	};
+
+	struct Queue
+	{
+		mutex       lock;
+		deque<Task> tasks;
+	};
+
+
+	vector<thread>          m_threads;
+
+	/** One queue per worker, the last one is for the external threads */
+	vector<Queue*>          m_queues;
+
+	atomic<int>             m_queued;
+	bool                    m_stop;
+
+	mutex                   m_sleepMutex;
+	condition_variable      m_wake;
+
+
+	/** Worker index of the current thread, -1 if outside the pool */
+	static thread_local int s_index;
+
+
+	bool Pop(Task& task)
+	{
+		const int count = (int)m_queues.size();
+		const int shared = count - 1;
+
+		//own tasks first, the most recent one as its data is probably still in cache
+		if (s_index >= 0)
+		{
+			Queue& own = *m_queues[s_index];
+			lock_guard<mutex> l(own.lock);
+
+			if (!own.tasks.empty())
+			{
+				task = own.tasks.back();
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+
+		//then the shared queue and finally steal the oldest task from the others
+		for (int i = 0; i < count; i++)
+		{
+			int index = (shared + i) % count;
+
+			if (index == s_index)
+			{
+				continue;
+			}
+
+			Queue& other = *m_queues[index];
+			lock_guard<mutex> l(other.lock);
+
+			if (!other.tasks.empty())
+			{
+				task = other.tasks.front();
+				other.tasks.pop_front();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void WorkerLoop(int index)
+	{
+		s_index = index;
+
+		while (true)
+		{
+			if (RunOne())
+			{
+				continue;
+			}
+
+			unique_lock<mutex> l(m_sleepMutex);
+
+			m_wake.wait(l, [this]() { return m_stop || m_queued > 0; });
+
+			if (m_stop && m_queued == 0)
+			{
+				return;
+			}
+		}
+	}
+
+public:
+
+
+	/** The calling thread counts as one, so count - 1 workers are created */
+	ThreadPool(int count)
+	{
+		m_queued = 0;
+		m_stop = false;
+
+		const int workers = max(0, count - 1);
+
+		for (int i = 0; i < workers + 1; i++)
+		{
+			m_queues.push_back(new Queue);
+		}
+
+		for (int i = 0; i < workers; i++)
+		{
+			m_threads.push_back(thread(&ThreadPool::WorkerLoop, this, i));
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			lock_guard<mutex> l(m_sleepMutex);
+			m_stop = true;
+		}
+
+		m_wake.notify_all();
+
+		for (size_t i = 0; i < m_threads.size(); i++)
+		{
+			m_threads[i].join();
+		}
+
+		for (size_t i = 0; i < m_queues.size(); i++)
+		{
+			delete m_queues[i];
+		}
+	}
+
+	void Push(const TaskGroup::Task& fn, TaskGroup* pGroup)
+	{
+		Queue& queue = *m_queues[s_index >= 0 ? s_index : m_queues.size() - 1];
+
+		{
+			lock_guard<mutex> l(queue.lock);
+
+			Task task;
+			task.fn = fn;
+			task.pGroup = pGroup;
+
+			queue.tasks.push_back(task);
+			m_queued++;
+		}
+
+		//taking the lock avoids missing a worker that is about to sleep
+		{
+			lock_guard<mutex> l(m_sleepMutex);
+		}
+
+		m_wake.notify_one();
+	}
+
+	/** Runs a pending task if any, returns false if there was nothing to do */
+	bool RunOne()
+	{
+		Task task;
+
+		if (!Pop(task))
+		{
+			return false;
+		}
+
+		m_queued--;
+
+		task.pGroup->Execute(task.fn);
+
+		return true;
+	}
+
+	static ThreadPool& Get()
+	{
+		static ThreadPool pool(GetThreadCount());
+
+		return pool;
+	}
+
+};
+
+thread_local int ThreadPool::s_index = -1;
+
+
+
+
+void SetThreadCount(int count)
+{
+	threadCount = count;
+}
+
+int GetThreadCount()
+{
+	if (threadCount <= 0)
+	{
+		threadCount = max(1, (int)thread::hardware_concurrency());
+	}
+
+	return threadCount;
+}
+
+void ParallelFor(int first, int last, int grain, const function<void(int, int)>& fn)
+{
+	if (last <= first)
+	{
+		return;
+	}
+
+	const int count = last - first;
+	const int threads = GetThreadCount();
+
+	grain = max(1, grain);
+
+	if (threads <= 1 || count <= grain)
+	{
+		fn(first, last);
+		return;
+	}
+
+	//a few chunks per thread so the stealing can balance uneven work
+	int chunks = min((count + grain - 1) / grain, threads * 4);
+	int size = (count + chunks - 1) / chunks;
+
+	TaskGroup group;
+
+	for (int begin = first + size; begin < last; begin += size)
+	{
+		int end = min(begin + size, last);
+
+		group.Run([=, &fn]() { fn(begin, end); });
+	}
+
+	//the calling thread takes the first chunk
+	fn(first, min(first + size, last));
+
+	group.Wait();
+}
+
+TaskGroup::TaskGroup()
+{
+	m_pending = 0;
+}
+
+TaskGroup::~TaskGroup()
+{
+	WaitPending();
+}
+
+void TaskGroup::Run(const Task& task)
+{
+	m_pending++;
+
+	if (GetThreadCount() <= 1)
+	{
+		Execute(task);
+		return;
+	}
+
+	ThreadPool::Get().Push(task, this);
+}
+
+void TaskGroup::Execute(const function<void()>& task)
+{
+	//the pending count must go down even if the task throws, or Wait would never return
+	struct DoneGuard
+	{
+		TaskGroup* pGroup;
+
+		~DoneGuard() { pGroup->Done(); }
+
+	} guard = { this };
+
+	try
+	{
+		task();
+	}
+	catch (...)
+	{
+		lock_guard<mutex> l(m_mutex);
+
+		if (!m_exception)
+		{
+			m_exception = current_exception();
+		}
+	}
+}
+
+void TaskGroup::Wait()
+{
+	WaitPending();
+
+	exception_ptr exception;
+
+	{
+		lock_guard<mutex> l(m_mutex);
+		swap(exception, m_exception);
+	}
+
+	if (exception)
+	{
+		rethrow_exception(exception);
+	}
+}
+
+void TaskGroup::WaitPending()
+{
+	while (m_pending > 0)
+	{
+		if (ThreadPool::Get().RunOne())
+		{
+			continue;
+		}
+
+		//the remaining tasks are running in other threads
+		unique_lock<mutex> l(m_mutex);
+
+		m_done.wait_for(l, chrono::milliseconds(1), [this]() { return m_pending == 0; });
+	}
+
+	//makes sure Done() is not still notifying before the group goes away
+	lock_guard<mutex> l(m_mutex);
+}
+
+void TaskGroup::Done()
+{
+	lock_guard<mutex> l(m_mutex);
+
+	if (--m_pending == 0)
+	{
+		m_done.notify_all();
+	}
+}
+
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __KTXTOOL_PARALLEL_INCLUDED
+#define __KTXTOOL_PARALLEL_INCLUDED
+
+
+
+
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#ifdef KTXTOOL_TBB
+#include <tbb/task_group.h>
+#endif
+
+
+
+
+
+/** Multithreading for the hot loops. By default this runs on a small built-in
+ *  work stealing pool (std::thread), with WITH-TBB the same calls are forwarded
+ *  to Intel's TBB instead. Calls can be nested, a thread waiting for its work
+ *  runs pending tasks meanwhile. */
+
+
+
+
+
+/** Sets the amount of threads used (including the calling thread). Zero or
+ *  negative uses all the hardware threads. Must be called before any
+ *  parallel work is issued, ie. while parsing the options. */
+void SetThreadCount(int count);
+
+
+
+
+/** Returns the amount of threads used (including the calling thread) */
+int GetThreadCount();
+
+
+
+
+/** Runs fn(begin, end) over the [first, last) range split in chunks of at least
+ *  grain items. Blocks until the whole range has been processed. */
+void ParallelFor(int first, int last, int grain, const std::function<void(int, int)>& fn);
+
+
+
+
+/** Group of tasks that can be waited for, tasks may add more tasks to
+ *  the same group while running. */
+class TaskGroup
+{
+#ifdef KTXTOOL_TBB
+
+	tbb::task_group         m_group;
+
+#else
+
+	std::atomic<int>        m_pending;
+	std::mutex              m_mutex;
+	std::condition_variable m_done;
+
+	/** The first exception thrown by a task, rethrown by Wait */
+	std::exception_ptr      m_exception;
+
+#endif
+
+	TaskGroup(const TaskGroup&);
+	TaskGroup& operator=(const TaskGroup&);
+
+
+	friend class ThreadPool;
+
+	/** Used by the pool when a task of this group finished */
+	void Done();
+
+
+	/** Runs a task of this group, Done is called even if it throws */
+	void Execute(const std::function<void()>& task);
+
+
+	/** Wait without rethrowing, for the destructor */
+	void WaitPending();
+
+public:
+
+	typedef std::function<void()> Task;
+
+
+	TaskGroup();
+
+
+	/** Waits for the remaining tasks, an exception not collected by
+	 *  Wait is dropped */
+	~TaskGroup();
+
+
+
+	/** Queues a task, it might start right away in another thread */
+	void Run(const Task& task);
+
+
+
+	/** Blocks until all the tasks have finished. The calling thread runs
+	 *  pending tasks meanwhile. If a task threw, the first exception is
+	 *  rethrown here once all the others are done */
+	void Wait();
+
+};
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+#endif
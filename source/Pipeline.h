@@ -0,0 +1,266 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __KTXTOOL_PIPELINE_INCLUDED
+#define __KTXTOOL_PIPELINE_INCLUDED
+
+
+
+
+#include <assert.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <exception>
+
+
+
+
+
+/** Fixed capacity queue between two pipeline stages. Push blocks while
+ *  the queue is full and Pop blocks while it's empty. */
+template<typename T>
+class BoundedQueue
+{
+	std::deque<T>           m_items;
+	size_t                  m_capacity;
+	bool                    m_closed;
+
+	std::mutex              m_mutex;
+	std::condition_variable m_notFull;
+	std::condition_variable m_notEmpty;
+
+public:
+
+
+	inline BoundedQueue(size_t capacity)
+	{
+		m_capacity = capacity > 0 ? capacity : 1;
+		m_closed = false;
+	}
+
+	inline void Push(const T& item)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+
+		m_notFull.wait(l, [this]() { return m_items.size() < m_capacity; });
+
+		m_items.push_back(item);
+
+		m_notEmpty.notify_one();
+	}
+
+	/** Returns false once the queue is closed and there's nothing left */
+	inline bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+
+		m_notEmpty.wait(l, [this]() { return m_closed || !m_items.empty(); });
+
+		if (m_items.empty())
+		{
+			return false;
+		}
+
+		item = m_items.front();
+		m_items.pop_front();
+
+		m_notFull.notify_one();
+
+		return true;
+	}
+
+	/** No more items will be pushed */
+	inline void Close()
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+
+		m_closed = true;
+
+		m_notEmpty.notify_all();
+	}
+};
+
+
+
+
+/** Runs items through a sequence of stages, each stage has its own threads
+ *  (the concurrency limit) and a bounded queue in front of it, so while an
+ *  item is in a stage the following item can be in the previous one. An
+ *  exception thrown by a stage is given to the error handler and the item
+ *  goes on to the next stage, the pipeline keeps draining. */
+template<typename T>
+class Pipeline
+{
+public:
+
+	typedef std::function<void(T&)> StageFn;
+
+	/** Called with the item, the name of the stage and the message */
+	typedef std::function<void(T&, const std::string&, const char*)> ErrorFn;
+
+protected:
+
+	struct Stage
+	{
+		std::string name;
+		int         concurrency;
+		StageFn     fn;
+	};
+
+	std::vector<Stage> m_stages;
+	size_t             m_queueSize;
+	ErrorFn            m_onError;
+
+public:
+
+
+	/** queueSize is the amount of items waiting in front of each stage */
+	inline Pipeline(size_t queueSize = 1)
+	{
+		m_queueSize = queueSize;
+	}
+
+	inline void AddStage(const char* name, int concurrency, const StageFn& fn)
+	{
+		Stage stage;
+		stage.name = name;
+		stage.concurrency = concurrency > 0 ? concurrency : 1;
+		stage.fn = fn;
+
+		m_stages.push_back(stage);
+	}
+
+	/** Called from the stage threads, so it must be thread safe */
+	inline void SetErrorHandler(const ErrorFn& fn)
+	{
+		m_onError = fn;
+	}
+
+	/** Runs all the items through every stage, in order of arrival. Blocks
+	 *  until the last item leaves the last stage. */
+	inline void Run(const std::vector<T>& items)
+	{
+		const size_t count = m_stages.size();
+
+		if (count == 0)
+		{
+			return;
+		}
+
+		//queues[s] is the input of the stage s, the last one is the output
+		std::vector<BoundedQueue<T>*> queues;
+
+		for (size_t s = 0; s < count; s++)
+		{
+			queues.push_back(new BoundedQueue<T>(m_queueSize));
+		}
+
+		std::vector<std::atomic<int>*> running;
+		std::vector<std::thread> threads;
+
+		for (size_t s = 0; s < count; s++)
+		{
+			running.push_back(new std::atomic<int>(m_stages[s].concurrency));
+
+			for (int t = 0; t < m_stages[s].concurrency; t++)
+			{
+				threads.push_back(std::thread([this, s, count, &queues, &running]()
+				{
+					T item;
+
+					while (queues[s]->Pop(item))
+					{
+						//an item that fails must not take the whole pipeline down
+						try
+						{
+							m_stages[s].fn(item);
+						}
+						catch (const std::exception& e)
+						{
+							if (m_onError)
+							{
+								m_onError(item, m_stages[s].name, e.what());
+							}
+						}
+						catch (...)
+						{
+							if (m_onError)
+							{
+								m_onError(item, m_stages[s].name, "unknown exception");
+							}
+						}
+
+						if (s + 1 < count)
+						{
+							queues[s + 1]->Push(item);
+						}
+					}
+
+					//the last thread of a stage closes the next one
+					if (--(*running[s]) == 0 && s + 1 < count)
+					{
+						queues[s + 1]->Close();
+					}
+				}));
+			}
+		}
+
+		//feed the first stage
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			queues[0]->Push(items[i]);
+		}
+
+		queues[0]->Close();
+
+		for (size_t i = 0; i < threads.size(); i++)
+		{
+			threads[i].join();
+		}
+
+		for (size_t s = 0; s < count; s++)
+		{
+			delete queues[s];
+			delete running[s];
+		}
+	}
+
+};
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+#endif
@@ -26,30 +26,103 @@
 
 
 #include <assert.h>
+#include <string.h>
+#include <inttypes.h>
 #include <string>
 #include <Types.h>
+#include <Buffer.h>
 
 
 
 
 
 
-/** This class is not meant for speed neither has a small memory footprint
- *  as is intended to run on desktop computers, convert and compress
- *  your textures for runtime usage in GL or even D3D. */
+/** Size in bytes of a sample of the type */
+inline int GetSampleSize(SampleType type)
+{
+	switch (type)
+	{
+	case SAMPLE_UINT8:  return 1;
+	case SAMPLE_UINT16: return 2;
+	case SAMPLE_HALF:   return 2;
+	case SAMPLE_FLOAT:  return 4;
+	}
+
+	return 4;
+}
+
+
+
+
+/** IEEE 754 half (binary16) to float, including denormals, inf and nan */
+inline float HalfToFloat(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exp = (h >> 10) & 0x1f;
+	uint32_t mant = h & 0x3ff;
+
+	uint32_t bits;
+
+	if (exp == 0)
+	{
+		if (mant == 0)
+		{
+			bits = sign;
+		}
+		else
+		{
+			//denormal, normalize it
+			exp = 127 - 15 + 1;
+
+			while ((mant & 0x400) == 0)
+			{
+				mant <<= 1;
+				exp--;
+			}
+
+			bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+		}
+	}
+	else if (exp == 0x1f)
+	{
+		bits = sign | 0x7f800000 | (mant << 13);
+	}
+	else
+	{
+		bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+	}
+
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+
+	return f;
+}
+
+
+
+
+/** The decoded pixels of an image, the samples keep the type of the source
+ *  (8 or 16 bit integers, half or float) so an 8-bit image takes a byte per
+ *  component instead of a float. Integer samples are unorm, floats [0, 1].
+ *  The samples are owned, so it can be moved but not copied. */
 class PixelData
 {
 protected:
 
 
-	float*  m_pData;
-	int     m_w;
-	int     m_h;
-	int     m_compCount;
+	Buffer     m_data;
+	int        m_w;
+	int        m_h;
+	int        m_compCount;
 
 	/** The format it's just a hint as the pixel data has 4 components, 
 	 *  regardless of this. */
-	Format  m_format;
+	Format     m_format;
+
+	SampleType m_type;
+
+	PixelData(const PixelData&);
+	PixelData& operator=(const PixelData&);
 
 public:
 	
@@ -57,8 +130,11 @@ public:
 
 
 	
-	/** Inlined as this is just a container class */
-	inline PixelData(int w, int h, Format format)
+	/** Inlined as this is just a container class. 8-bit samples come from
+	 *  the arena if any, then the pixel data must not outlive it. Wider ones
+	 *  are always on the heap: they are converted and freed right away, in
+	 *  the arena they would stay until the job ends */
+	inline PixelData(int w, int h, Format format, SampleType type = SAMPLE_FLOAT, Arena* pArena = nullptr)
 	{
 		switch (format)
 		{
@@ -67,43 +143,99 @@ public:
 		}
 
 		m_format = format;
+		m_type = type;
 		m_w = w;
 		m_h = h;
-		m_pData = new float[(w * h) * m_compCount];
+		m_data = Buffer(GetDataSize(), type == SAMPLE_UINT8 ? pArena : nullptr);
+	}
+
+	/** The other one is left empty, without samples and zero sized */
+	inline PixelData(PixelData&& other) noexcept
+	{
+		m_w = 0;
+		m_h = 0;
+
+		*this = std::move(other);
 	}
 
-	/** Deletes the data if not null*/
-	inline ~PixelData()
+	inline PixelData& operator=(PixelData&& other) noexcept
 	{
-		if (m_pData)
+		if (this != &other)
 		{
-			delete[] m_pData;
-			m_pData = nullptr;
+			m_data = std::move(other.m_data);
+			m_w = other.m_w;
+			m_h = other.m_h;
+			m_compCount = other.m_compCount;
+			m_format = other.m_format;
+			m_type = other.m_type;
+
+			other.m_w = 0;
+			other.m_h = 0;
 		}
+
+		return *this;
 	}
 
 	
-	/*inline Pixel& GetAt(int x, int y)
+	/** Float samples only */
+	inline float& Get(int i)
 	{
-		size_t i = (m_w * m_h) - ((y * m_w) + (m_w - x));
+		assert(m_type == SAMPLE_FLOAT);
 
+		return ((float*)m_data.Get())[i];
+	}
 
-		return m_pData[i];
-	}*/
+	/** Float samples only */
+	inline float* GetPixel(int i)
+	{
+		assert(m_type == SAMPLE_FLOAT);
 
-	inline float& Get(int i)
+		return ((float*)m_data.Get()) + (i * m_compCount);
+	}
+
+	/** The samples as their native type, T must match the sample size */
+	template<typename T>
+	inline T* GetSamples()
 	{
-		return m_pData[i];
+		assert(sizeof(T) == GetSampleSize(m_type));
+
+		return (T*)m_data.Get();
 	}
 
-	inline float* GetPixel(int i)
+	/** Any sample type normalized to [0, 1], slow, prefer GetSamples() in loops */
+	inline float GetNormalized(int i) const
+	{
+		const uint8_t* pData = m_data.Get();
+
+		switch (m_type)
+		{
+		case SAMPLE_UINT8:  return pData[i] / 255.f;
+		case SAMPLE_UINT16: return ((const uint16_t*)pData)[i] / 65535.f;
+		case SAMPLE_HALF:   return HalfToFloat(((const uint16_t*)pData)[i]);
+		case SAMPLE_FLOAT:  return ((const float*)pData)[i];
+		}
+
+		return 0.f;
+	}
+
+	/** Hands the samples over to the caller. Keeps the dimmension and 
+	 *  format but has no samples anymore */
+	inline Buffer DetachBuffer()
 	{
-		return m_pData + (i * m_compCount);
+		return std::move(m_data);
 	}
 
 	inline Format GetFormat() const { return m_format; }
 
-	inline void* GetData() { return m_pData; }
+	inline SampleType GetSampleType() const { return m_type; }
+
+	inline void* GetData() { return m_data.Get(); }
+
+	/** Size of the samples buffer in bytes */
+	inline size_t GetDataSize() const 
+	{
+		return (size_t)m_w * m_h * m_compCount * GetSampleSize(m_type);
+	}
 
 	inline int GetWidth() const { return m_w; }
 	inline int GetHeight() const { return m_h; }
@@ -32,6 +32,9 @@
 #define KTXTOOL_GL_RGB8 32849
 #define KTXTOOL_GL_RGBA8 32856
 
+#define KTXTOOL_GL_SRGB8 35905
+#define KTXTOOL_GL_SRGB8_ALPHA8 35907
+
 #define KTXTOOL_GL_UNSIGNED_BYTE 5121
 #define KTXTOOL_GL_UNSIGNED_SHORT 5123
 #define KTXTOOL_GL_UNSIGNED_INT 5125
@@ -45,6 +48,34 @@ enum Format
 	FORMAT_RGBA
 };
 
+/** Type of each component of a pixel, decoders keep the native one */
+enum SampleType
+{
+	SAMPLE_UINT8,
+	SAMPLE_UINT16,
+	SAMPLE_HALF,
+	SAMPLE_FLOAT
+};
+
+/** Transfer function conversion applied while the pixels are converted into
+ *  the container format, none keeps the values as they are */
+enum ColorTransform
+{
+	COLOR_TRANSFORM_NONE,
+	COLOR_TRANSFORM_SRGB_TO_LINEAR,
+	COLOR_TRANSFORM_LINEAR_TO_SRGB
+};
+
+/** Filter used to generate the mipmaps, box is the 2x2 average, the others
+ *  are wider separable filters (sharper, slower) */
+enum MipFilter
+{
+	MIP_FILTER_BOX,
+	MIP_FILTER_KAISER,
+	MIP_FILTER_LANCZOS3,
+	MIP_FILTER_MITCHELL
+};
+
 enum ColorDepth
 {
 	COLOR_DEPTH_8BIT,
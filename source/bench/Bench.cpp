@@ -0,0 +1,1007 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <memory>
+#include <atomic>
+#include <stdexcept>
+#include <new>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ktx/Convert.h>
+#include "Planar.h"
+#include <ktx/Reduce.h>
+#include <ktx/Filter.h>
+#include <ktx/Container.h>
+#include <Parallel.h>
+#include <PixelData.h>
+
+
+
+
+/** Micro benchmarks of the hot kernels, not part of the tool. Built with 
+ *  WITH-BENCH, run ktxtool-bench [--check] [MB] */
+
+
+
+using namespace std;
+
+
+
+
+
+/** Runs fn until a bit more than the time budget is spent, returns the best 
+ *  time of a single run in seconds */
+static double Measure(const function<void()>& fn, double budget = 0.5)
+{
+	double best = 1e9;
+	double total = 0.0;
+
+	//warm up, the pages get mapped
+	fn();
+
+	do
+	{
+		auto start = chrono::steady_clock::now();
+
+		fn();
+
+		chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+		best = min(best, elapsed.count());
+		total += elapsed.count();
+
+	} while (total < budget);
+
+	return best;
+}
+
+/** Random samples slightly out of [0, 1], so the clamping is exercised */
+static void FillSamples(vector<float>& samples, unsigned seed)
+{
+	mt19937 rng(seed);
+	uniform_real_distribution<float> dist(-0.1f, 1.1f);
+
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		samples[i] = dist(rng);
+	}
+}
+
+
+
+
+/** All the kernels must give exactly the same results as the scalar one */
+static bool CheckConvert()
+{
+	//edge cases first, the rest random. The odd size leaves a tail for the scalar code
+	vector<float> samples(4099);
+	FillSamples(samples, 7);
+
+	const float edges[] = 
+	{
+		0.f, -0.f, 1.f, -1.f, 2.f, 0.5f / 255.f, 1.5f / 255.f, 254.5f / 255.f, 
+		1e-30f, -1e30f, 1e30f, NAN, -NAN, INFINITY, -INFINITY
+	};
+
+	copy(edges, edges + sizeof(edges) / sizeof(edges[0]), samples.begin());
+
+	vector<uint8_t> reference(samples.size());
+	ConvertFloatToUnorm8(&samples[0], &reference[0], samples.size(), CONVERT_SCALAR);
+
+	bool ok = true;
+
+	//sanity of the reference
+	if (reference[0] != 0 || reference[2] != 255 || reference[3] != 0 || reference[4] != 255 || 
+		reference[6] != 2 || reference[7] != 255 || reference[11] != 0 || reference[13] != 255)
+	{
+		cerr << "convert scalar: unexpected results" << endl;
+		ok = false;
+	}
+
+	for (int k = CONVERT_SCALAR + 1; k < CONVERT_KERNEL_COUNT; k++)
+	{
+		ConvertKernel kernel = (ConvertKernel)k;
+
+		if (!IsConvertKernelSupported(kernel))
+		{
+			cout << "convert " << GetConvertKernelName(kernel) << ": not supported, skipped" << endl;
+			continue;
+		}
+
+		vector<uint8_t> out(samples.size());
+		ConvertFloatToUnorm8(&samples[0], &out[0], samples.size(), kernel);
+
+		size_t mismatches = 0;
+
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			if (out[i] != reference[i])
+			{
+				mismatches++;
+			}
+		}
+
+		cout << "convert " << GetConvertKernelName(kernel) << ": " << (mismatches ? "FAILED" : "ok") << endl;
+
+		ok = ok && mismatches == 0;
+	}
+
+	return ok;
+}
+
+
+
+
+/** The tabulated transfer functions against the exact ones, at most one 8-bit
+ *  step apart (the rounding of values right at the middle) */
+static bool CheckColor()
+{
+	vector<float> samples(4096 * 4);
+	FillSamples(samples, 11);
+
+	bool ok = true;
+
+	for (int t = COLOR_TRANSFORM_SRGB_TO_LINEAR; t <= COLOR_TRANSFORM_LINEAR_TO_SRGB; t++)
+	{
+		const ColorTransform transform = (ColorTransform)t;
+
+		vector<float> converted(samples);
+		ColorConverter(transform, true, 4).Apply(&converted[0], converted.size());
+
+		int maxError = 0;
+
+		for (size_t i = 0; i < samples.size(); i += 4)
+		{
+			double alpha = min(max((double)samples[i + 3], 0.0), 1.0);
+
+			for (int c = 0; c < 4; c++)
+			{
+				double v = min(max((double)samples[i + c], 0.0), 1.0);
+
+				if (c < 3 && transform == COLOR_TRANSFORM_SRGB_TO_LINEAR)
+				{
+					v = (v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4)) * alpha;
+				}
+				else if (c < 3)
+				{
+					v *= alpha;
+					v = v <= 0.0031308 ? v * 12.92 : 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+				}
+
+				int expected = (int)(v * 255.0 + 0.5);
+				int result = (int)(min(max(converted[i + c], 0.f), 1.f) * 255.f + 0.5f);
+
+				maxError = max(maxError, abs(expected - result));
+			}
+		}
+
+		cout << "color " << (transform == COLOR_TRANSFORM_SRGB_TO_LINEAR ? "to linear" : "to srgb") << ": " << (maxError <= 1 ? "ok" : "FAILED") << endl;
+
+		ok = ok && maxError <= 1;
+	}
+
+	//the unorm8 version against the float one, every colour with a few alphas
+	for (int t = COLOR_TRANSFORM_NONE; t <= COLOR_TRANSFORM_LINEAR_TO_SRGB; t++)
+	{
+		for (int premultiply = 0; premultiply < 2; premultiply++)
+		{
+			const ColorConverter converter((ColorTransform)t, premultiply != 0, 4);
+
+			vector<uint8_t> bytes;
+
+			for (int a = 0; a < 256; a += 17)
+			{
+				for (int v = 0; v < 256; v++)
+				{
+					bytes.push_back(v);
+					bytes.push_back(255 - v);
+					bytes.push_back(v);
+					bytes.push_back(a);
+				}
+			}
+
+			vector<float> floats(bytes.size());
+			vector<uint8_t> expected(bytes.size());
+
+			for (size_t i = 0; i < bytes.size(); i++)
+			{
+				floats[i] = bytes[i] / 255.f;
+			}
+
+			converter.Apply(&floats[0], floats.size());
+			ConvertFloatToUnorm8(&floats[0], &expected[0], floats.size(), CONVERT_SCALAR);
+
+			converter.Apply(&bytes[0], &bytes[0], bytes.size());
+
+			int maxError = 0;
+
+			for (size_t i = 0; i < bytes.size(); i++)
+			{
+				maxError = max(maxError, abs(bytes[i] - expected[i]));
+			}
+
+			if (maxError > 1)
+			{
+				cout << "color unorm8 " << t << (premultiply ? " premultiplied" : "") << ": FAILED" << endl;
+				ok = false;
+			}
+		}
+	}
+
+	return ok;
+}
+
+
+
+
+static void BenchConvert(size_t bytes)
+{
+	vector<float> samples(bytes / sizeof(float));
+	vector<uint8_t> out(samples.size());
+
+	FillSamples(samples, 1);
+
+	cout << "float -> unorm8, " << (bytes >> 20) << "MB of floats" << endl;
+
+	double scalar = 0.0;
+
+	for (int k = 0; k < CONVERT_KERNEL_COUNT; k++)
+	{
+		ConvertKernel kernel = (ConvertKernel)k;
+
+		if (!IsConvertKernelSupported(kernel))
+		{
+			continue;
+		}
+
+		double seconds = Measure([&]()
+		{
+			ConvertFloatToUnorm8(&samples[0], &out[0], samples.size(), kernel);
+		});
+
+		//read and written
+		double gbs = (samples.size() * (sizeof(float) + 1)) / seconds / 1e9;
+
+		if (kernel == CONVERT_SCALAR)
+		{
+			scalar = seconds;
+		}
+
+		cout << "  " << left << setw(8) << GetConvertKernelName(kernel);
+		cout << fixed << setprecision(2) << gbs << " GB/s";
+		cout << "  x" << scalar / seconds << endl;
+	}
+}
+
+
+
+
+/** The colour conversion of unorm8 pixels as the float path did it (normalized,
+ *  converted and packed back in chunks) against the byte tables */
+static void BenchColor(int w)
+{
+	vector<uint8_t> pixels(w * w * 4);
+
+	mt19937 rng(5);
+
+	for (size_t i = 0; i < pixels.size(); i++)
+	{
+		pixels[i] = rng();
+	}
+
+	vector<uint8_t> out(pixels.size());
+
+	cout << "colour conversion to linear, " << w << "x" << w << " rgba unorm8" << endl;
+
+	for (int premultiply = 0; premultiply < 2; premultiply++)
+	{
+		const ColorConverter converter(COLOR_TRANSFORM_SRGB_TO_LINEAR, premultiply != 0, 4);
+
+		double floats = Measure([&]()
+		{
+			float chunk[256];
+
+			for (size_t i = 0; i < pixels.size(); i += 256)
+			{
+				for (int j = 0; j < 256; j++)
+				{
+					chunk[j] = pixels[i + j] / 255.f;
+				}
+
+				converter.Apply(chunk, 256);
+				ConvertFloatToUnorm8(chunk, &out[i], 256);
+			}
+		});
+
+		double bytes = Measure([&]()
+		{
+			converter.Apply(&pixels[0], &out[0], pixels.size());
+		});
+
+		cout << "  " << left << setw(14) << (premultiply ? "premultiplied" : "plain");
+		cout << fixed << setprecision(1) << "floats " << floats * 1000.0 << " ms, bytes " << bytes * 1000.0 << " ms";
+		cout << "  x" << setprecision(2) << floats / bytes << endl;
+	}
+}
+
+
+
+
+/** A container with a random w x w image of comp components, ready for the mipmaps */
+static void InitContainer(Container& ktx, int w, int h, int comp, const vector<uint8_t>& pixels, MipFilter filter = MIP_FILTER_BOX)
+{
+	Format format = comp == 4 ? FORMAT_RGBA : FORMAT_RGB;
+
+	ktx.Init(w, h, 1, 1);
+	ktx.SetFormat(format, COLOR_DEPTH_8BIT);
+	ktx.SetMipFilter(filter);
+
+	PixelData data(w, h, format, SAMPLE_UINT8);
+	memcpy(data.GetData(), &pixels[0], data.GetDataSize());
+
+	ktx.SetData(0, 0, std::move(data));
+}
+
+static void FillPixels(vector<uint8_t>& pixels, unsigned seed)
+{
+	mt19937 rng(seed);
+
+	for (size_t i = 0; i < pixels.size(); i++)
+	{
+		pixels[i] = rng() & 0xff;
+	}
+}
+
+/** All the reduction kernels must give exactly the same results as the scalar
+ *  one. Odd widths leave tails of every size for the scalar code */
+static bool CheckReduce()
+{
+	const int comps[] = { 1, 3, 4 };
+
+	bool ok = true;
+
+	for (int k = CONVERT_SCALAR + 1; k < CONVERT_KERNEL_COUNT; k++)
+	{
+		ConvertKernel kernel = (ConvertKernel)k;
+
+		if (!IsConvertKernelSupported(kernel))
+		{
+			continue;
+		}
+
+		size_t mismatches = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			const int comp = comps[i];
+
+			for (int w2 = 1; w2 <= 67; w2++)
+			{
+				vector<uint8_t> rows(w2 * 2 * comp * 2);
+				FillPixels(rows, w2);
+
+				const uint8_t* r0 = &rows[0];
+				const uint8_t* r1 = &rows[w2 * 2 * comp];
+
+				vector<uint8_t> reference(w2 * comp);
+				vector<uint8_t> out(w2 * comp);
+
+				ReduceRows(r0, r1, &reference[0], w2, comp, CONVERT_SCALAR);
+				ReduceRows(r0, r1, &out[0], w2, comp, kernel);
+
+				mismatches += out != reference;
+			}
+		}
+
+		cout << "reduce " << GetConvertKernelName(kernel) << ": " << (mismatches ? "FAILED" : "ok") << endl;
+
+		ok = ok && mismatches == 0;
+	}
+
+	//the chain built tile by tile against level by level, smaller and bigger than a tile
+	for (int w = 1; w <= 512; w *= 8)
+	{
+		for (int comp = 3; comp <= 4; comp++)
+		{
+			vector<vector<uint8_t> > reference;
+			vector<vector<uint8_t> > chain;
+			vector<ImageView> levels;
+
+			for (int lw = w; lw >= 1; lw /= 2)
+			{
+				reference.push_back(vector<uint8_t>(lw * lw * comp));
+				chain.push_back(vector<uint8_t>(lw * lw * comp));
+			}
+
+			FillPixels(reference[0], comp);
+			chain[0] = reference[0];
+
+			for (size_t m = 0; m < chain.size(); m++)
+			{
+				levels.push_back(ImageView(&chain[m][0], w >> m, w >> m, comp));
+			}
+
+			for (size_t m = 1; m < reference.size(); m++)
+			{
+				const int lw = w >> m;
+
+				for (int y = 0; y < lw; y++)
+				{
+					const uint8_t* r0 = &reference[m - 1][y * 2 * lw * 2 * comp];
+
+					ReduceRows(r0, r0 + lw * 2 * comp, &reference[m][y * lw * comp], lw, comp);
+				}
+			}
+
+			ReduceChain(&levels[0], (int)levels.size(), comp);
+
+			bool same = chain == reference;
+
+			cout << "reduce chain " << w << "x" << w << " " << (comp == 4 ? "rgba" : "rgb") << ": " << (same ? "ok" : "FAILED") << endl;
+
+			ok = ok && same;
+		}
+	}
+
+	return ok;
+}
+
+/** The vertical pass of the filters, every kernel must give exactly the same
+ *  results as the scalar one. A flat image must stay flat with every filter */
+static bool CheckFilters()
+{
+	const int taps = 12;
+	const size_t count = 1027;
+
+	vector<float> samples(taps * count);
+	FillSamples(samples, 5);
+
+	vector<const float*> rows(taps);
+
+	for (int k = 0; k < taps; k++)
+	{
+		rows[k] = &samples[k * count];
+	}
+
+	//lanczos like weights, with negative lobes
+	const float weights[taps] = { -0.01f, 0.02f, -0.05f, 0.08f, 0.15f, 0.31f, 0.31f, 0.15f, 0.08f, -0.05f, 0.02f, -0.01f };
+
+	vector<float> reference(count);
+	FilterColumns(&rows[0], weights, taps, &reference[0], count, CONVERT_SCALAR);
+
+	bool ok = true;
+
+	for (int k = CONVERT_SCALAR + 1; k < CONVERT_KERNEL_COUNT; k++)
+	{
+		ConvertKernel kernel = (ConvertKernel)k;
+
+		if (!IsConvertKernelSupported(kernel))
+		{
+			continue;
+		}
+
+		vector<float> out(count);
+		FilterColumns(&rows[0], weights, taps, &out[0], count, kernel);
+
+		bool same = memcmp(&out[0], &reference[0], count * sizeof(float)) == 0;
+
+		cout << "filter " << GetConvertKernelName(kernel) << ": " << (same ? "ok" : "FAILED") << endl;
+
+		ok = ok && same;
+	}
+
+	//the odd sizes use the tables with the box filter as well
+	for (int i = 0; i < 8; i++)
+	{
+		const MipFilter filter = (MipFilter)(i % 4);
+		const int w = i < 4 ? 64 : 37;
+		const int h = i < 4 ? 64 : 100;
+
+		vector<uint8_t> pixels(w * h * 3);
+
+		for (size_t p = 0; p < pixels.size(); p++)
+		{
+			pixels[p] = 17 + (p % 3) * 100;
+		}
+
+		Container ktx;
+		InitContainer(ktx, w, h, 3, pixels, filter);
+		ktx.GenerateMipmaps();
+
+		const Container::MipmapArray& mipmaps = ktx.GetMipmaps();
+
+		//the GL sizes down to 1x1
+		bool flat = mipmaps.back().w == 1 && mipmaps.back().h == 1;
+
+		for (size_t m = 1; m < mipmaps.size(); m++)
+		{
+			flat = flat && mipmaps[m].w == max(1, w >> m) && mipmaps[m].h == max(1, h >> m);
+			flat = flat && memcmp(mipmaps[m].elems[0][0].data.Get(), &pixels[0], mipmaps[m].w * mipmaps[m].h * 3) == 0;
+		}
+
+		cout << "filter " << GetMipFilterName(filter) << " flat " << w << "x" << h << ": " << (flat ? "ok" : "FAILED") << endl;
+
+		ok = ok && flat;
+	}
+
+	return ok;
+}
+
+/** The mipmap chain in the planar layout: the top level is split once, every
+ *  level is filtered plane by plane (the box while both sides are even, the
+ *  tables afterwards, as Container::GenerateMipmaps does) and merged back */
+static vector<vector<uint8_t> > GeneratePlanarChain(const vector<uint8_t>& pixels, int w, int h, int comp, MipFilter filter)
+{
+	vector<vector<uint8_t> > levels;
+
+	PlanarImage planes(w, h, comp);
+
+	Deinterleave(ImageView((void*)&pixels[0], w, h, comp), planes);
+
+	bool box = filter == MIP_FILTER_BOX;
+
+	while (planes.GetWidth() > 1 || planes.GetHeight() > 1)
+	{
+		const int srcW = planes.GetWidth();
+		const int srcH = planes.GetHeight();
+
+		box = box && srcW % 2 == 0 && srcH % 2 == 0;
+
+		unique_ptr<FilterTable> pWidthTable;
+		unique_ptr<FilterTable> pHeightTable;
+
+		if (!box)
+		{
+			pWidthTable.reset(new FilterTable(filter, srcW));
+			pHeightTable.reset(new FilterTable(filter, srcH));
+		}
+
+		planes = DownsamplePlanar(planes, nullptr, pWidthTable.get(), pHeightTable.get());
+
+		const int levelW = planes.GetWidth();
+		const int levelH = planes.GetHeight();
+
+		levels.push_back(vector<uint8_t>(levelW * levelH * comp));
+
+		Interleave(planes, ImageView(&levels.back()[0], levelW, levelH, comp));
+	}
+
+	return levels;
+}
+
+/** Both layouts must give the same mipmaps */
+static bool CheckLayouts()
+{
+	bool ok = true;
+
+	//square power of 2 and odd non square sizes, every filter
+	for (int i = 0; i < 16; i++)
+	{
+		const int w = i < 8 ? 256 : 203;
+		const int h = i < 8 ? 256 : 76;
+		const int comp = 3 + i % 2;
+		const MipFilter filter = (MipFilter)(i / 2 % 4);
+
+		vector<uint8_t> pixels(w * h * comp);
+		FillPixels(pixels, comp);
+
+		Container interleaved;
+
+		InitContainer(interleaved, w, h, comp, pixels, filter);
+
+		interleaved.GenerateMipmaps();
+
+		const Container::MipmapArray& a = interleaved.GetMipmaps();
+		const vector<vector<uint8_t> > b = GeneratePlanarChain(pixels, w, h, comp, filter);
+
+		bool same = a.size() == b.size() + 1;
+
+		for (size_t m = 1; same && m < a.size(); m++)
+		{
+			size_t size = a[m].w * a[m].h * comp;
+
+			same = b[m - 1].size() == size && memcmp(a[m].elems[0][0].data.Get(), &b[m - 1][0], size) == 0;
+		}
+
+		cout << "mipmaps planar " << GetMipFilterName(filter) << " " << w << "x" << h << " " << (comp == 4 ? "rgba" : "rgb") << ": " << (same ? "ok" : "FAILED") << endl;
+
+		ok = ok && same;
+	}
+
+	return ok;
+}
+
+/** Writes an odd sized container and walks its levels, the imageSize of each
+ *  one must count the rows padded to 4 bytes and the rows must hold the pixels */
+static bool CheckWrite()
+{
+	const int w = 37;
+	const int h = 20;
+	const int comp = 3;
+
+	vector<uint8_t> pixels(w * h * comp);
+	FillPixels(pixels, 9);
+
+	Container ktx;
+
+	InitContainer(ktx, w, h, comp, pixels);
+
+	ktx.GenerateMipmaps();
+	ktx.Encode();
+
+	char path[] = "/tmp/ktxtool-bench.XXXXXX";
+	int fd = mkstemp(path);
+
+	bool ok = fd >= 0 && ktx.Write(path);
+
+	vector<uint8_t> file;
+
+	if (fd >= 0)
+	{
+		FILE* pFile = fdopen(fd, "rb");
+
+		int c;
+
+		while ((c = fgetc(pFile)) != EOF)
+		{
+			file.push_back(c);
+		}
+
+		fclose(pFile);
+		remove(path);
+	}
+
+	auto Read32 = [&](size_t offset)
+	{
+		uint32_t value = 0;
+
+		if (offset + 4 <= file.size())
+		{
+			memcpy(&value, &file[offset], 4);
+		}
+
+		return value;
+	};
+
+	//the header is 64 bytes, the last field is the size of the key values
+	size_t offset = 64 + Read32(60);
+
+	const Container::MipmapArray& levels = ktx.GetMipmaps();
+
+	for (size_t m = 0; ok && m < levels.size(); m++)
+	{
+		const int rowSize = levels[m].w * comp;
+		const int paddedRow = (rowSize + 3) & ~3;
+
+		uint32_t imageSize = Read32(offset);
+
+		ok = imageSize == (uint32_t)(paddedRow * levels[m].h) && offset + 4 + imageSize <= file.size();
+
+		for (int y = 0; ok && y < levels[m].h; y++)
+		{
+			const uint8_t* pRow = levels[m].elems[0][0].data.Get() + y * rowSize;
+
+			ok = memcmp(&file[offset + 4 + y * paddedRow], pRow, rowSize) == 0;
+		}
+
+		offset += 4 + imageSize;
+	}
+
+	ok = ok && offset == file.size();
+
+	cout << "write " << w << "x" << h << " rgb, padded rows: " << (ok ? "ok" : "FAILED") << endl;
+
+	return ok;
+}
+
+/** A task that throws must not hang the group, Wait rethrows its exception
+ *  once the other tasks are done, also through ParallelFor */
+static bool CheckTaskExceptions()
+{
+	atomic<int> finished(0);
+
+	bool caught = false;
+
+	try
+	{
+		TaskGroup group;
+
+		for (int i = 0; i < 64; i++)
+		{
+			group.Run([i, &finished]()
+			{
+				if (i == 7)
+				{
+					throw runtime_error("task");
+				}
+
+				finished++;
+			});
+		}
+
+		group.Wait();
+	}
+	catch (const runtime_error&)
+	{
+		caught = true;
+	}
+
+	bool ok = caught && finished == 63;
+
+	caught = false;
+
+	try
+	{
+		ParallelFor(0, 1024, 1, [](int first, int last)
+		{
+			if (first <= 1000 && 1000 < last)
+			{
+				throw bad_alloc();
+			}
+		});
+	}
+	catch (const bad_alloc&)
+	{
+		caught = true;
+	}
+
+	ok = ok && caught;
+
+	cout << "task exceptions: " << (ok ? "ok" : "FAILED") << endl;
+
+	return ok;
+}
+
+static void BenchReduce(int w)
+{
+	for (int comp = 3; comp <= 4; comp++)
+	{
+		vector<uint8_t> pixels(w * w * comp);
+		vector<uint8_t> out(pixels.size() / 4);
+
+		FillPixels(pixels, 1);
+
+		cout << "2x2 reduce " << w << "x" << w << " " << (comp == 4 ? "rgba" : "rgb") << endl;
+
+		const int w2 = w / 2;
+		const int rowSize = w * comp;
+
+		double scalar = 0.0;
+
+		for (int k = 0; k < CONVERT_KERNEL_COUNT; k++)
+		{
+			ConvertKernel kernel = (ConvertKernel)k;
+
+			if (!IsConvertKernelSupported(kernel))
+			{
+				continue;
+			}
+
+			//single threaded, the kernel on its own
+			double seconds = Measure([&]()
+			{
+				for (int y = 0; y < w2; y++)
+				{
+					const uint8_t* r0 = &pixels[y * 2 * rowSize];
+
+					ReduceRows(r0, r0 + rowSize, &out[y * w2 * comp], w2, comp, kernel);
+				}
+			});
+
+			//read and written
+			double gbs = (pixels.size() + out.size()) / seconds / 1e9;
+
+			if (kernel == CONVERT_SCALAR)
+			{
+				scalar = seconds;
+			}
+
+			cout << "  " << left << setw(8) << GetConvertKernelName(kernel);
+			cout << fixed << setprecision(2) << gbs << " GB/s";
+			cout << "  x" << scalar / seconds << endl;
+		}
+
+		//the whole chain, level by level against tile by tile
+		vector<vector<uint8_t> > chain(1);
+		vector<ImageView> levels(1, ImageView(&pixels[0], w, w, comp));
+
+		for (int lw = w / 2; lw >= 1; lw /= 2)
+		{
+			chain.push_back(vector<uint8_t>(lw * lw * comp));
+			levels.push_back(ImageView(&chain.back()[0], lw, lw, comp));
+		}
+
+		double perLevel = Measure([&]()
+		{
+			for (size_t m = 1; m < levels.size(); m++)
+			{
+				for (int y = 0; y < levels[m].h; y++)
+				{
+					ReduceRows(levels[m - 1].Row(y * 2), levels[m - 1].Row(y * 2 + 1), levels[m].Row(y), levels[m].w, comp);
+				}
+			}
+		});
+
+		double fused = Measure([&]() { ReduceChain(&levels[0], (int)levels.size(), comp); });
+
+		cout << "  chain   " << fixed << setprecision(1) << perLevel * 1000.0 << " ms per level, ";
+		cout << fused * 1000.0 << " ms fused  x" << setprecision(2) << perLevel / fused << endl;
+	}
+}
+
+static void BenchLayouts(int w)
+{
+	for (int comp = 3; comp <= 4; comp++)
+	{
+		vector<uint8_t> pixels(w * w * comp);
+		FillPixels(pixels, 1);
+
+		const double bytes = pixels.size();
+
+		cout << "mipmaps " << w << "x" << w << " " << (comp == 4 ? "rgba" : "rgb") << endl;
+
+		//the conversion between layouts on its own
+		PlanarImage planes(w, w, comp);
+		vector<uint8_t> out(pixels.size());
+
+		ImageView src(&pixels[0], w, w, comp);
+		ImageView dst(&out[0], w, w, comp);
+
+		double split = Measure([&]() { Deinterleave(src, planes); });
+		double merge = Measure([&]() { Interleave(planes, dst); });
+
+		cout << "  deinterleave " << fixed << setprecision(2) << (bytes * 2 / split / 1e9) << " GB/s" << endl;
+		cout << "  interleave   " << fixed << setprecision(2) << (bytes * 2 / merge / 1e9) << " GB/s" << endl;
+
+		//the whole chain, the planar one includes splitting and merging the levels
+		double interleaved = 0.0;
+
+		for (int planar = 0; planar < 2; planar++)
+		{
+			double best = 1e9;
+
+			for (int run = 0; run < 3; run++)
+			{
+				Container ktx;
+				InitContainer(ktx, w, w, comp, pixels);
+
+				auto start = chrono::steady_clock::now();
+
+				if (planar)
+				{
+					GeneratePlanarChain(pixels, w, w, comp, MIP_FILTER_BOX);
+				}
+				else
+				{
+					ktx.GenerateMipmaps();
+				}
+
+				chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+				best = min(best, elapsed.count());
+			}
+
+			if (!planar)
+			{
+				interleaved = best;
+			}
+
+			cout << "  " << left << setw(13) << (planar ? "planar" : "interleaved");
+			cout << fixed << setprecision(1) << best * 1000.0 << " ms";
+			cout << "  x" << setprecision(2) << interleaved / best << endl;
+		}
+
+		//the separable filters, interleaved against the box filter
+		for (int f = MIP_FILTER_KAISER; f <= MIP_FILTER_MITCHELL; f++)
+		{
+			double best = 1e9;
+
+			for (int run = 0; run < 3; run++)
+			{
+				Container ktx;
+				InitContainer(ktx, w, w, comp, pixels, (MipFilter)f);
+
+				auto start = chrono::steady_clock::now();
+
+				ktx.GenerateMipmaps();
+
+				chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+				best = min(best, elapsed.count());
+			}
+
+			cout << "  " << left << setw(13) << GetMipFilterName((MipFilter)f);
+			cout << fixed << setprecision(1) << best * 1000.0 << " ms";
+			cout << "  x" << setprecision(2) << interleaved / best << endl;
+		}
+	}
+}
+
+
+
+
+int main(int argc, char* argv[])
+{
+	bool check = false;
+	size_t megabytes = 64;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--check") == 0)
+		{
+			check = true;
+		}
+		else
+		{
+			megabytes = strtoul(argv[i], NULL, 10);
+
+			if (megabytes == 0)
+			{
+				cerr << "Usage: ktxtool-bench [--check] [MB]" << endl;
+				return 1;
+			}
+		}
+	}
+
+	if (check)
+	{
+		//a few threads even on a single core, so the strips of the mipmaps 
+		//run out of order as they would on a big machine
+		SetThreadCount(max(4, GetThreadCount()));
+
+		bool convert = CheckConvert();
+		bool color = CheckColor();
+		bool reduce = CheckReduce();
+		bool filters = CheckFilters();
+		bool layouts = CheckLayouts();
+		bool write = CheckWrite();
+		bool tasks = CheckTaskExceptions();
+
+		return convert && color && reduce && filters && layouts && write && tasks ? 0 : 2;
+	}
+
+	cout << "best kernel: " << GetConvertKernelName(GetConvertKernel()) << endl << endl;
+
+	BenchConvert(megabytes << 20);
+
+	cout << endl;
+
+	BenchColor(4096);
+
+	cout << endl;
+
+	BenchReduce(4096);
+
+	cout << endl;
+
+	BenchLayouts(4096);
+
+	return 0;
+}
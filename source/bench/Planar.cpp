@@ -0,0 +1,206 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+
+#include "Planar.h"
+#include <Parallel.h>
+#include <ktx/Reduce.h>
+#include <ktx/Filter.h>
+#include <utility>
+#include <algorithm>
+
+
+
+
+
+using namespace std;
+
+
+
+
+
+PlanarImage::PlanarImage()
+{
+	m_pBase = nullptr;
+	m_w = 0;
+	m_h = 0;
+	m_comp = 0;
+	m_pitch = 0;
+}
+
+PlanarImage::PlanarImage(int w, int h, int comp, Arena* pArena)
+{
+	m_w = w;
+	m_h = h;
+	m_comp = comp;
+	m_pitch = (w + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+	//the heap only guarantees 16 bytes, room to align the base
+	m_data = Buffer(m_pitch * h * comp + ALIGNMENT, pArena);
+
+	uintptr_t base = (uintptr_t)m_data.Get();
+	m_pBase = (uint8_t*)((base + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1));
+}
+
+PlanarImage::PlanarImage(PlanarImage&& other) noexcept
+{
+	m_pBase = nullptr;
+
+	*this = std::move(other);
+}
+
+PlanarImage& PlanarImage::operator=(PlanarImage&& other) noexcept
+{
+	if (this != &other)
+	{
+		m_data = std::move(other.m_data);
+		m_pBase = other.m_pBase;
+		m_w = other.m_w;
+		m_h = other.m_h;
+		m_comp = other.m_comp;
+		m_pitch = other.m_pitch;
+
+		other.m_pBase = nullptr;
+		other.m_w = 0;
+		other.m_h = 0;
+	}
+
+	return *this;
+}
+
+
+
+
+/** The components as a template argument, so the inner loops are unrolled */
+template<int COMP>
+static void DeinterleaveRows(const ImageView& src, PlanarImage& dst, int first, int last)
+{
+	for (int y = first; y < last; y++)
+	{
+		const uint8_t* pIn = src.Row(y);
+
+		uint8_t* planes[COMP];
+
+		for (int c = 0; c < COMP; c++)
+		{
+			planes[c] = dst.GetPlane(c) + y * dst.GetPitch();
+		}
+
+		for (int x = 0; x < src.w; x++, pIn += COMP)
+		{
+			for (int c = 0; c < COMP; c++)
+			{
+				planes[c][x] = pIn[c];
+			}
+		}
+	}
+}
+
+template<int COMP>
+static void InterleaveRows(const PlanarImage& src, const ImageView& dst, int first, int last)
+{
+	for (int y = first; y < last; y++)
+	{
+		uint8_t* pOut = dst.Row(y);
+
+		const uint8_t* planes[COMP];
+
+		for (int c = 0; c < COMP; c++)
+		{
+			planes[c] = src.GetPlane(c) + y * src.GetPitch();
+		}
+
+		for (int x = 0; x < dst.w; x++, pOut += COMP)
+		{
+			for (int c = 0; c < COMP; c++)
+			{
+				pOut[c] = planes[c][x];
+			}
+		}
+	}
+}
+
+void Deinterleave(const ImageView& src, PlanarImage& dst)
+{
+	assert(src.w == dst.GetWidth() && src.h == dst.GetHeight());
+	assert(src.pixelStride == dst.GetComponentCount());
+
+	ParallelFor(0, src.h, 16, [&](int first, int last)
+	{
+		switch (src.pixelStride)
+		{
+		case 3:  DeinterleaveRows<3>(src, dst, first, last); break;
+		case 4:  DeinterleaveRows<4>(src, dst, first, last); break;
+		default: assert(false); break;
+		}
+	});
+}
+
+void Interleave(const PlanarImage& src, const ImageView& dst)
+{
+	assert(src.GetWidth() == dst.w && src.GetHeight() == dst.h);
+	assert(dst.pixelStride == src.GetComponentCount());
+
+	ParallelFor(0, dst.h, 16, [&](int first, int last)
+	{
+		switch (dst.pixelStride)
+		{
+		case 3:  InterleaveRows<3>(src, dst, first, last); break;
+		case 4:  InterleaveRows<4>(src, dst, first, last); break;
+		default: assert(false); break;
+		}
+	});
+}
+
+
+
+
+PlanarImage DownsamplePlanar(const PlanarImage& src, Arena* pArena, const FilterTable* pWidthTable, const FilterTable* pHeightTable)
+{
+	const int w2 = max(1, src.GetWidth() / 2);
+	const int h2 = max(1, src.GetHeight() / 2);
+
+	PlanarImage dst(w2, h2, src.GetComponentCount(), pArena);
+
+	for (int c = 0; c < src.GetComponentCount(); c++)
+	{
+		ImageView from = src.GetView(c);
+		ImageView to = dst.GetView(c);
+
+		if (pWidthTable)
+		{
+			FilterDownsample(from, to, 1, *pWidthTable, *pHeightTable);
+			continue;
+		}
+
+		assert(w2 * 2 == from.w && h2 * 2 == from.h);
+
+		//the same kernel as the interleaved version, one sample per pixel
+		ParallelFor(0, h2, 16, [&](int first, int last)
+		{
+			for (int y = first; y < last; y++)
+			{
+				ReduceRows(from.Row(y * 2), from.Row(y * 2 + 1), to.Row(y), w2, 1);
+			}
+		});
+	}
+
+	return dst;
+}
@@ -0,0 +1,131 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+#ifndef __KTXTOOL_PLANAR_INCLUDED
+#define __KTXTOOL_PLANAR_INCLUDED
+
+
+
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <Buffer.h>
+#include <ImageView.h>
+
+
+
+class FilterTable;
+
+
+
+
+
+/** 8-bit image with one plane per channel (SoA) instead of interleaved pixels,
+ *  every row starts 64 bytes aligned. The filters then read contiguous bytes
+ *  of a single channel, which the compiler can vectorise. Only in the bench,
+ *  to compare against the interleaved chain of the container: splitting and
+ *  merging the planes costs more than what the filters gain. */
+class PlanarImage
+{
+	Buffer    m_data;
+	uint8_t*  m_pBase;
+
+	int       m_w;
+	int       m_h;
+	int       m_comp;
+
+	/** Bytes from a row to the next one, a multiple of ALIGNMENT */
+	ptrdiff_t m_pitch;
+
+	PlanarImage(const PlanarImage&);
+	PlanarImage& operator=(const PlanarImage&);
+
+public:
+
+
+	static const int ALIGNMENT = 64;
+
+
+	PlanarImage();
+
+	/** Allocates the planes, uninitialized. From the arena if any */
+	PlanarImage(int w, int h, int comp, Arena* pArena = nullptr);
+
+	PlanarImage(PlanarImage&& other) noexcept;
+
+	PlanarImage& operator=(PlanarImage&& other) noexcept;
+
+
+
+	inline uint8_t* GetPlane(int c) const
+	{
+		assert(c >= 0 && c < m_comp);
+
+		return m_pBase + c * m_pitch * m_h;
+	}
+
+	/** View of a single channel, top-down */
+	inline ImageView GetView(int c) const
+	{
+		ImageView view(GetPlane(c), m_w, m_h, 1);
+		view.rowStride = m_pitch;
+
+		return view;
+	}
+
+	inline int GetWidth() const { return m_w; }
+	inline int GetHeight() const { return m_h; }
+	inline int GetComponentCount() const { return m_comp; }
+	inline ptrdiff_t GetPitch() const { return m_pitch; }
+};
+
+
+
+
+/** Splits the interleaved pixels of src into the planes of dst, which must
+ *  have the same dimmension and components (the pixel stride of src) */
+void Deinterleave(const ImageView& src, PlanarImage& dst);
+
+
+
+
+/** Merges the planes of src into the interleaved pixels of dst */
+void Interleave(const PlanarImage& src, const ImageView& dst);
+
+
+
+
+/** Half size image, max(1, size / 2), with the same filters as the interleaved
+ *  chain per plane: the 2x2 box without tables (even sizes only), otherwise the
+ *  tables of the width and height. Gives exactly the same pixels as the 
+ *  interleaved version. */
+PlanarImage DownsamplePlanar(const PlanarImage& src, Arena* pArena = nullptr, const FilterTable* pWidthTable = nullptr, const FilterTable* pHeightTable = nullptr);
+
+
+
+
+
+
+
+
+
+
+#endif
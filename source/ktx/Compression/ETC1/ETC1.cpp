@@ -25,22 +25,74 @@
 #include "rg_etc1.h"
 #include <assert.h>
 #include <cstring>
+#include <algorithm>
 
-#ifdef KTXTOOL_TBB
+#include <Parallel.h>
+#include <ImageView.h>
 
-#include <tbb/blocked_range2d.h>
-#include <tbb/parallel_for.h>
-#include <tbb/task_scheduler_init.h>
 
-using namespace tbb;
 
-#endif
 
+using namespace rg_etc1;
+using namespace std;
 
 
 
-using namespace rg_etc1;
-using namespace std;
+
+
+/** Packs the rows of blocks [first, last), the components as a template argument
+ *  so the gather has a fixed size. The blocks are always RGBA. The blocks over
+ *  the right and bottom edges (sizes not multiple of 4, ie. the small levels)
+ *  repeat the last column and row */
+template<int COMP>
+static void CompressRows(const ImageView& src, uint8_t* out, int first, int last, etc1_pack_params& params)
+{
+	const int bw = (src.w + 3) / 4;
+
+	uint32_t block[16];
+
+	for (int by = first; by < last; by++)
+	{
+		for (int bx = 0; bx < bw; bx++)
+		{
+			const bool inside = bx * 4 + 4 <= src.w && by * 4 + 4 <= src.h;
+
+			for (int iy = 0; iy < 4; iy++)
+			{
+				const uint8_t* pIn = src.Row(min(by * 4 + iy, src.h - 1));
+				uint8_t* pOut = (uint8_t*)(block + iy * 4);
+
+				if (!inside)
+				{
+					for (int ix = 0; ix < 4; ix++)
+					{
+						memcpy(pOut + ix * 4, pIn + min(bx * 4 + ix, src.w - 1) * COMP, COMP);
+					}
+				}
+				else if (COMP == 4)
+				{
+					//the whole row at once, then the alpha
+					memcpy(pOut, pIn + bx * 16, 16);
+				}
+				else
+				{
+					for (int ix = 0; ix < 4; ix++)
+					{
+						memcpy(pOut + ix * 4, pIn + (bx * 4 + ix) * COMP, COMP);
+					}
+				}
+
+				for (int ix = 0; ix < 4; ix++)
+				{
+					pOut[ix * 4 + 3] = 255;
+				}
+			}
+
+			pack_etc1_block(out + (by * bw + bx) * 8, block, params);
+		}
+	}
+}
+
 
 
 
@@ -48,6 +100,12 @@ using namespace std;
 ETC1::ETC1()
 {
 	m_quality = QUALITY_DRAFT;
+
+	//the packer tables are global, build them once per process (thread safe static init)
+	static bool initialized = (pack_etc1_block_init(), true);
+
+	assert(initialized);
+	(void)initialized;
 }
 
 ETC1::~ETC1()
@@ -65,13 +123,8 @@ uint32_t ETC1::GetInternalFormat(Format format, ColorDepth depth)
 }
 
 
-#define At(w, h, x, y) ((w * h) - (((y) * w) + (w - (x))))
-
-
 uint32_t ETC1::Compress(void* in, void* out, int w, int h, Format format, ColorDepth depth)
 {
-	pack_etc1_block_init();
-
 	//only 8bit allowed
 	if (depth != COLOR_DEPTH_8BIT)
 	{
@@ -104,129 +157,24 @@ uint32_t ETC1::Compress(void* in, void* out, int w, int h, Format format, ColorD
 
 	int c = format == FORMAT_RGBA ? 4 : 3;
 
-	int bw = w / 4;
-	int bh = h / 4;
+	//the source, the pixels of a block and the blocks order used to be all addressed 
+	//bottom-up, the flips cancel out so everything is walked as it is in memory
+	ImageView src(in, w, h, c);
 
 
-#ifdef KTXTOOL_TBB
-	
-	
-	class EncodeBlocks
+	//every row of blocks is independent
+	ParallelFor(0, (h + 3) / 4, 1, [&](int first, int last)
 	{
-		uint8_t* in;
-		uint8_t* out;
-		int c;
-		int w;
-		int h;
-		int bw;
-		int bh;
-		etc1_pack_params* params;
-
-	public:	
-
-
-		void operator()(const blocked_range2d<int>& r) const
+		if (c == 4)
 		{
-			
-
-
-			for (int by = r.rows().begin(); by != r.rows().end(); by++)
-			{
-				for (int bx = r.cols().begin(); bx != r.cols().end(); bx++) 
-				{
-					int x = bx * 4;
-					int y = by * 4;
-					
-									
-					int offset = At(bw, bh, bx, by) * 8;
-
-
-					uint32_t block[16];
-
-
-
-					for (int ix = 0; ix < 4; ix++)
-					{
-						for (int iy = 0; iy < 4; iy++)
-						{
-							int i1 = At(4, 4, ix, iy);
-							int i2 = At(w, h, x + ix, y + iy);
-
-							uint8_t* p1 = (uint8_t*)&block[i1];
-							uint8_t* p2 = &((uint8_t*)in)[i2 * c];
-
-							memcpy(p1, p2, c);
-
-							p1[3] = 255;
-						}
-					}
-
-					pack_etc1_block(((char*)out) + offset, block, *params);
-
-				}
-        	}
-		}
-
-		EncodeBlocks(void* _in, void* _out, int _bw, int _bh, int _w, int _h, int _c, etc1_pack_params* _params)
-		{
-			in = (uint8_t*)_in;
-			out = (uint8_t*)_out;
-			c = _c;
-			w = _w;
-			h = _h;
-			bw = _bw;
-			bh = _bh;
-			params = _params;
+			CompressRows<4>(src, (uint8_t*)out, first, last, params);
 		}
-
-	};
-
-
-	parallel_for(blocked_range2d<int>(0, bw, 1, 0, bh, 1), EncodeBlocks(in, out, bw, bh, w, h, c, &params));
-
-
-#else
-
-	uint32_t block[16];
-
-
-	int size = (int)GetSize(w, h);
-
-
-	for (int by = 0; by < bh; by++)
-	{
-		for (int bx = 0; bx < bw; bx++)
+		else
 		{
-			int x = bx * 4;
-			int y = by * 4;
-			
-			
-			int offset = At(bw, bh, bx, by) * 8;
-
-
-			for (int ix = 0; ix < 4; ix++)
-			{
-				for (int iy = 0; iy < 4; iy++)
-				{
-					int i1 = At(4, 4, ix, iy);
-					int i2 = At(w, h, x + ix, y + iy);
-
-					uint8_t* p1 = (uint8_t*)&block[i1];
-					uint8_t* p2 = &((uint8_t*)in)[i2 * c];
-
-					memcpy(p1, p2, c);
-
-					p1[3] = 255;
-				}
-			}
-
-
-			pack_etc1_block(((char*)out) + offset, block, params);
-
+			CompressRows<3>(src, (uint8_t*)out, first, last, params);
 		}
-	}
+	});
 
-#endif
 
 	//assert((uint32_t)offset == GetSize(w, h));
 
@@ -235,15 +183,9 @@ uint32_t ETC1::Compress(void* in, void* out, int w, int h, Format format, ColorD
 
 uint32_t ETC1::GetSize(int w, int h)
 {
-	//TODO check for non-power of two dimensions
-	
-	auto Count = [&](int dim) -> int
-	{
-		return dim <= 4 ? 1 : dim / 4;
-	};
-
-	int blockW = Count(w);
-	int blockH = Count(h);
+	//partial blocks at the right and bottom edges count as whole ones
+	int blockW = (w + 3) / 4;
+	int blockH = (h + 3) / 4;
 
 	int totalBlocks = blockW * blockH;
 
@@ -23,9 +23,15 @@
 #include <assert.h>
 #include <Types.h>
 #include <PixelData.h>
+#include <Parallel.h>
+#include "Convert.h"
+#include "Reduce.h"
+#include "Filter.h"
 #include <iostream>
+#include <algorithm>
 #include <math.h>
 #include <fstream>
+#include <memory>
 #include <string>
 #include "Compression/Compression.h"
 
@@ -49,6 +55,20 @@ using namespace std;
 Container::Container()
 {
 	m_pCompression = nullptr;
+	m_encoded = false;
+	m_pArena = nullptr;
+	m_mipFilter = MIP_FILTER_BOX;
+	m_colorTransform = COLOR_TRANSFORM_NONE;
+	m_premultiply = false;
+}
+
+Container::~Container()
+{
+	if (m_pCompression)
+	{
+		delete m_pCompression;
+		m_pCompression = nullptr;
+	}
 }
 
 void Container::Init(int w, int h, int elementCount, int faceCount)
@@ -71,6 +91,8 @@ void Container::Init(int w, int h, int elementCount, int faceCount)
 	m_header.numberOfMipmapLevels = 0;
 	m_header.bytesOfKeyValueData = 0;
 
+	m_keyValues.clear();
+
 
 	m_mipmaps.resize(1);
 
@@ -86,12 +108,6 @@ void Container::Init(int w, int h, int elementCount, int faceCount)
 	for (size_t e = 0; e < mmp.elems.size(); e++)
 	{
 		mmp.elems[e].resize(faceCount);
-
-		for (size_t f = 0; f < mmp.elems[e].size(); f++)
-		{
-			mmp.elems[e][f].pData = nullptr;
-		}
-
 	}
 
 
@@ -151,7 +167,76 @@ void Container::SetFormat(Format format, ColorDepth depth, Compression* pComp)
 	}
 }
 
-void Container::SetData(int elementIndex, int faceIndex, PixelData* pData)
+void Container::SetColorConversion(ColorTransform transform, bool premultiply)
+{
+	assert(m_comp > 0 && "SetFormat must be called first");
+
+	m_colorTransform = transform;
+	m_premultiply = premultiply && m_comp == 4;
+
+	switch (transform)
+	{
+	case COLOR_TRANSFORM_SRGB_TO_LINEAR:
+		AddKeyValue("ColorSpace", "linear");
+		break;
+	case COLOR_TRANSFORM_LINEAR_TO_SRGB:
+		AddKeyValue("ColorSpace", "srgb");
+
+		//ETC1 has no sRGB format, then the key is all there is
+		if (!m_pCompression)
+		{
+			m_header.glInternalFormat = m_comp == 4 ? KTXTOOL_GL_SRGB8_ALPHA8 : KTXTOOL_GL_SRGB8;
+		}
+		break;
+	default:
+		break;
+	}
+
+	if (m_premultiply)
+	{
+		AddKeyValue("PremultipliedAlpha", "true");
+	}
+}
+
+void Container::AddKeyValue(const string& key, const string& value)
+{
+	m_keyValues.push_back(make_pair(key, value));
+
+	//the size, both strings with their terminator, padded to 4 bytes
+	uint32_t size = key.size() + 1 + value.size() + 1;
+
+	m_header.bytesOfKeyValueData += 4 + ((size + 3) & ~3u);
+}
+
+/** Converts a row in small chunks of whole pixels, Load(i) returns the sample
+ *  i of the row normalized. The colour conversion and the 8-bit kernel run on
+ *  each chunk while it's still in the cache */
+template<typename LoadFn>
+static void ConvertRow(const ColorConverter& converter, int comp, int rowSize, uint8_t* pOut, const LoadFn& Load)
+{
+	float chunk[256];
+
+	const int chunkSize = (256 / comp) * comp;
+
+	for (int i = 0; i < rowSize; i += chunkSize)
+	{
+		int size = min(chunkSize, rowSize - i);
+
+		for (int j = 0; j < size; j++)
+		{
+			chunk[j] = Load(i + j);
+		}
+
+		if (!converter.IsIdentity())
+		{
+			converter.Apply(chunk, size);
+		}
+
+		ConvertFloatToUnorm8(chunk, pOut + i, size);
+	}
+}
+
+void Container::SetData(int elementIndex, int faceIndex, PixelData&& data, bool flipY)
 {
 	assert((size_t)elementIndex < m_mipmaps[0].elems.size()); 
 
@@ -159,19 +244,124 @@ void Container::SetData(int elementIndex, int faceIndex, PixelData* pData)
 
 	Face& face = m_mipmaps[0].elems[elementIndex][faceIndex];
 
+	//taken, the samples are freed when converted
+	PixelData pixels(std::move(data));
+	PixelData* pData = &pixels;
+
 	assert(m_comp == pData->GetComponentCount());
 
-	face.pData = new uint8_t[pData->GetPixelCount() * m_comp];
+	m_encoded = false;
+
+	const int w = pData->GetWidth();
+	const int h = pData->GetHeight();
+	const int rowSize = w * m_comp;
+
+	//done in the same pass as the 8-bit conversion
+	const ColorConverter converter(m_colorTransform, m_premultiply, m_comp);
+
+	//same type, no conversion neither copy, the buffer is moved
+	if (pData->GetSampleType() == SAMPLE_UINT8)
+	{
+		face.data = pData->DetachBuffer();
+
+		ImageView view(face.data.Get(), w, h, m_comp);
+
+		//in place, swapping the rows of each half
+		if (flipY)
+		{
+			ImageView flipped = view.FlipY();
+
+			ParallelFor(0, h / 2, 64, [&](int first, int last)
+			{
+				for (int y = first; y < last; y++)
+				{
+					swap_ranges(view.Row(y), view.Row(y) + rowSize, flipped.Row(y));
+				}
+			});
+		}
+
+		//in place as well, straight from the bytes with the tables of the converter
+		if (!converter.IsIdentity())
+		{
+			ParallelFor(0, h, 64, [&](int first, int last)
+			{
+				for (int y = first; y < last; y++)
+				{
+					uint8_t* pRow = view.Row(y);
+
+					converter.Apply(pRow, pRow, rowSize);
+				}
+			});
+		}
 
+		return;
+	}
 
-	for (size_t i = 0; i < (size_t)pData->GetPixelCount() * m_comp; i++)
+	face.data = Buffer(h * rowSize, m_pArena);
+
+	//the rows are converted into the flipped view, so the flip is free
+	ImageView dst(face.data.Get(), w, h, m_comp);
+
+	if (flipY)
 	{
-		((uint8_t*)face.pData)[i] = (pData->Get(i) * 255.f);
+		dst = dst.FlipY();
 	}
 
+	ParallelFor(0, h, 64, [&](int first, int last)
+	{
+		for (int y = first; y < last; y++)
+		{
+			const int offset = y * rowSize;
+
+			uint8_t* pOut = dst.Row(y);
+
+			auto Load = [pData, offset](int i) { return pData->GetNormalized(offset + i); };
+
+			//the colour conversion needs floats anyway
+			if (!converter.IsIdentity())
+			{
+				ConvertRow(converter, m_comp, rowSize, pOut, Load);
+				continue;
+			}
+
+			switch (pData->GetSampleType())
+			{
+			case SAMPLE_UINT16:
+			{
+				const uint16_t* pIn = pData->GetSamples<uint16_t>() + offset;
+
+				//rounded v * 255 / 65535
+				for (int i = 0; i < rowSize; i++)
+				{
+					pOut[i] = (pIn[i] * 255u + 32767u) / 65535u;
+				}
+
+				break;
+			}
+			case SAMPLE_HALF:
+			{
+				//to floats in small chunks, then the same kernel (clamps HDR values)
+				ConvertRow(converter, m_comp, rowSize, pOut, Load);
+
+				break;
+			}
+			default:
+			{
+				const float* pIn = pData->GetSamples<float>() + offset;
+
+				ConvertFloatToUnorm8(pIn, pOut, rowSize);
+
+				break;
+			}
+			}
+		}
+	});
+
+	//the mipmaps read it back band by band
+	face.data.Evict();
 }
 
-void Container::GenerateMipmaps()
+void Container::GenerateMipmaps(bool dumpMipmaps)
 {
 	auto DumpMipmap = [this](MipmapLevel& mmp)
 	{
@@ -185,163 +375,181 @@ void Container::GenerateMipmaps()
 	};
 
 
-	bool dumpMipmaps = GetOption('d')->IsDefined();
-
 	assert(m_mipmaps.size() == 1);
 
-	if (!IsSqrPowerOf2())
+	int refW = m_mipmaps[0].w;
+	int refH = m_mipmaps[0].h;
+
+	//the GL sizes, every level is half the previous one rounded down (at least 1)
+	//down to 1x1, so the count is given by the largest dimension
+	m_header.numberOfMipmapLevels = 1;
+
+	for (int size = max(refW, refH); size > 1; size /= 2)
 	{
-		cout << "KTX Container: Unable to generate mipmaps (non square power of 2)" << endl;
-		return;
+		m_header.numberOfMipmapLevels++;
 	}
 
-	m_header.numberOfMipmapLevels = 1 + floor(log10((float)m_header.pixelWidth) / log10(2.0f));
-
 	//resize the mipmap array
 	m_mipmaps.resize(m_header.numberOfMipmapLevels);
 
-	int refW = m_mipmaps[0].w;
-	int refH = m_mipmaps[0].h;
+	m_encoded = false;
 
 	//make sure that the reference mipmap has valid face
 	assert(m_mipmaps[0].elems.size() == 1);
 	assert(m_mipmaps[0].elems[0].size() >= 1);
 
-	Face& refFace = m_mipmaps[0].elems[0][0];
-		
-	assert(refFace.pData != nullptr);
+	assert(!m_mipmaps[0].elems[0][0].data.IsEmpty());
 	
 
 
-	for (size_t m = 0; m < m_mipmaps.size(); m++)
+	for (size_t m = 1; m < m_mipmaps.size(); m++)
 	{
 		MipmapLevel& mmp = m_mipmaps[m];
+		MipmapLevel& upmmp = m_mipmaps[m - 1];
 
-		if (m > 0)
-		{
-			MipmapLevel& upmmp = m_mipmaps[m - 1];
+		mmp.w = max(1, refW >> m);
+		mmp.h = max(1, refH >> m);
 
-			
-			mmp.w = (refW >> m);
-			mmp.h = (refH >> m);
+		mmp.elems.resize(upmmp.elems.size());
 
-			mmp.elems.resize(upmmp.elems.size());
+		for (size_t e = 0; e < mmp.elems.size(); e++)
+		{
+			mmp.elems[e].resize(upmmp.elems[e].size());
+		}
+	}
 
-			for (size_t e = 0; e < mmp.elems.size(); e++)
-			{
-				mmp.elems[e].resize(upmmp.elems[e].size());
 
-				for (size_t f = 0; f < mmp.elems[e].size(); f++)
-				{
-					mmp.elems[e][f].pData = Downsample(upmmp.elems[e][f].pData, upmmp.w, upmmp.h);
-				}
-				
-			}
-		}
+	//the box filter reduces 2x2 pixels while the levels are exactly half the 
+	//previous one, the levels after the first odd size (or a side of 1) are 
+	//filtered with the tables instead
+	const int count = (int)m_mipmaps.size();
 
-		if (dumpMipmaps) DumpMipmap(mmp);
+	int boxLevels = 1;
 
+	if (m_mipFilter == MIP_FILTER_BOX)
+	{
+		while (boxLevels < count &&
+			m_mipmaps[boxLevels].w * 2 == m_mipmaps[boxLevels - 1].w &&
+			m_mipmaps[boxLevels].h * 2 == m_mipmaps[boxLevels - 1].h)
+		{
+			boxLevels++;
+		}
 	}
-}
 
+	//the weights of the filters, once per level for all the faces. Square 
+	//levels share the same table for both dimensions
+	vector<unique_ptr<FilterTable> > tables;
+	vector<const FilterTable*> widthTables(count);
+	vector<const FilterTable*> heightTables(count);
 
-static void GetAvgPx(uint8_t* pixels, uint8_t* out, int comp, int w, int h, int x, int y)
-{
-	//uint8_t pixel[4];
-	//uint8_t* pixel = &pixels[((w * h)-((y * w) + (w - x))) * comp];
-
-	auto GetAvgComp = [&](int c) -> uint8_t
+	for (int m = boxLevels; m < count; m++)
 	{
-		//counts how many pixels have been added
-		int against = 1;
+		const MipmapLevel& upmmp = m_mipmaps[m - 1];
 
-		float avg = 0.0f;
+		tables.push_back(unique_ptr<FilterTable>(new FilterTable(m_mipFilter, upmmp.w)));
+		widthTables[m] = tables.back().get();
 
-		//return float as the avg is done in a normalized space
-		auto At = [&](int ix, int iy)
+		if (upmmp.h != upmmp.w)
 		{
-			int fx = x + ix;
-			int fy = y + iy;
-
-			if (fx >= w || fx < 0 || fy >= h || fy < 0)
-			{
-				return;
-			}
-
-			uint8_t* pixel = &pixels[((w * h) - ((fy * w) + (w - fx))) * comp];
-
-			against++;
+			tables.push_back(unique_ptr<FilterTable>(new FilterTable(m_mipFilter, upmmp.h)));
+		}
 
-			avg += pixel[c] / 255.f;
-		};
+		heightTables[m] = tables.back().get();
+	}
 
-		At(0, 0);
 
-		At(1, 1);  At(-1, -1);
-		At(0, 1);  At(0, -1);
-		At(1, 0);  At(-1, 0);
-		At(1, -1); At(-1, 1);
+	//the faces and elements don't depend on each other, every chain runs at 
+	//once and each one splits its levels in parallel work as well
+	TaskGroup group;
 
-		return (avg / against) * 255.f;
-	};
+	for (size_t e = 0; e < m_mipmaps[0].elems.size(); e++)
+	{
+		for (size_t f = 0; f < m_mipmaps[0].elems[e].size(); f++)
+		{
+			group.Run([this, e, f, boxLevels, &widthTables, &heightTables]()
+			{
+				GenerateChain(e, f, boxLevels, &widthTables[0], &heightTables[0]);
+			});
+		}
+	}
 
+	group.Wait();
 
-	//allow maximum 4 components per pixel
-	for (int c = 0; c < comp; c++)
+	if (dumpMipmaps)
 	{
-		out[c] = GetAvgComp(c);
+		for (size_t m = 0; m < m_mipmaps.size(); m++)
+		{
+			DumpMipmap(m_mipmaps[m]);
+		}
 	}
 }
 
-void* Container::Downsample(void* pData, int w, int h)
-{
-	int w2 = w / 2;
-	int h2 = h / 2;
-
-	void* pDataOut = new uint8_t[(w2 * h2) * m_comp];
 
-	uint8_t* pixels = (uint8_t*)pData;
+void Container::GenerateChain(int e, int f, int boxLevels, const FilterTable* const* pWidthTables, const FilterTable* const* pHeightTables)
+{
+	const int count = (int)m_mipmaps.size();
 
+	vector<ImageView> levels(count);
 
-	for (int y = 0; y < h; y += 2)
+	for (int m = 0; m < count; m++)
 	{
-		for (int x = 0; x < w; x += 2) 
+		MipmapLevel& mmp = m_mipmaps[m];
+
+		if (m > 0)
 		{
-			uint8_t* to = &((uint8_t*)pDataOut)[((w2 * h2)-(((y / 2) * w2) + (w2 - (x / 2)))) * m_comp];  
-	
-			GetAvgPx(pixels, to, m_comp, w, h, x, y);	
+			mmp.elems[e][f].data = Buffer((mmp.w * mmp.h) * m_comp, m_pArena);
 		}
 
+		levels[m] = GetView(mmp, e, f);
 	}
 
-	return pDataOut;
-}
+	//the whole chain at once, the box filter in one pass over the face band 
+	//by band, the tables strip by strip as the rows they read are done
+	if (boxLevels > 1)
+	{
+		ReduceChain(&levels[0], boxLevels, m_comp);
+	}
 
+	if (boxLevels < count)
+	{
+		const int first = boxLevels - 1;
 
-void Container::WriteFaceToPPM(MipmapLevel& mmp, int elemIndex, int faceIndex, const char* filePath)
-{
-	ofstream ppm(filePath);	
+		FilterChain(&levels[first], count - first, m_comp, pWidthTables + first, pHeightTables + first);
+	}
 
-	size_t w = mmp.w;
-	size_t h = mmp.h;
+	for (int m = 0; m < count; m++)
+	{
+		m_mipmaps[m].elems[e][f].data.Evict();
+	}
+}
 
+ImageView Container::GetView(const MipmapLevel& mmp, int elemIndex, int faceIndex) const
+{
 	assert((size_t)elemIndex < mmp.elems.size());
 
 	assert((size_t)faceIndex < mmp.elems[elemIndex].size());
 
-	uint8_t* pixels = (uint8_t*)mmp.elems[elemIndex][faceIndex].pData;
+	return ImageView(mmp.elems[elemIndex][faceIndex].data.Get(), mmp.w, mmp.h, m_comp);
+}
+
+
+void Container::WriteFaceToPPM(MipmapLevel& mmp, int elemIndex, int faceIndex, const char* filePath)
+{
+	ofstream ppm(filePath);	
+
+	ImageView view = GetView(mmp, elemIndex, faceIndex);
 
 	ppm << "P3" << endl;
-	ppm << (int)w << " " << (int)h << endl;
+	ppm << view.w << " " << view.h << endl;
 	ppm << 255 << endl;
 
 
-	for (size_t y = (h-1); y < h; y--)
+	for (int y = 0; y < view.h; y++)
 	{
-		for (size_t x = 0; x < w; x++) 
+		const uint8_t* pixel = view.Row(y);
+
+		for (int x = 0; x < view.w; x++, pixel += view.pixelStride) 
 		{
-			uint8_t* pixel = &pixels[((w * h) - ((y * w) + (w - x))) * m_comp];
-			
 			ppm << (int)pixel[0] << " ";
 			ppm << (int)pixel[1] << " ";
 			ppm << (int)pixel[2] << "	";
@@ -355,8 +563,58 @@ void Container::WriteFaceToPPM(MipmapLevel& mmp, int elemIndex, int faceIndex, c
 	cout << "Face writen to " << filePath << endl;
 }
 
+void Container::Encode()
+{
+	//without compression the pixel data is already in its final format
+	if (m_pCompression)
+	{
+		cout << "Compressing with " << m_pCompression->GetName() << endl;
+
+		//all the images are compressed at once instead of level by level, so the
+		//small levels fill the gaps left by the large ones. Queued largest first
+		TaskGroup group;
+
+		for (size_t m = 0; m < m_mipmaps.size(); m++)
+		{
+			MipmapLevel& mmp = m_mipmaps[m];
+
+			for (size_t e = 0; e < mmp.elems.size(); e++)
+			{
+				for (size_t f = 0; f < mmp.elems[e].size(); f++)
+				{
+					Face& face = mmp.elems[e][f];
+
+					group.Run([this, &face, &mmp]()
+					{
+						face.compressed = Buffer(m_pCompression->GetSize(mmp.w, mmp.h), m_pArena);
+
+						size_t size = m_pCompression->Compress(face.data.Get(), face.compressed.Get(), mmp.w, mmp.h, m_format, m_depth);
+
+						assert(face.compressed.GetSize() == size);
+						(void)size;
+
+						face.data.Evict();
+						face.compressed.Evict();
+					});
+				}
+			}
+		}
+
+		group.Wait();
+	}
+
+	m_encoded = true;
+}
+
 bool Container::Write(const char* filePath) const
 {	
+	//data not ready, the compression can't be done here as it's const
+	if (!m_encoded)
+	{
+		cout << "Couldn't write '" << filePath << "', the container is not encoded" << endl;
+		return false;
+	}
+
 
 	ofstream file(filePath, ofstream::out | ofstream::trunc | ofstream::binary);
 	
@@ -377,28 +635,31 @@ bool Container::Write(const char* filePath) const
 	uint32_t dummy = 0;
 
 
-	//buffer to hold down compressed data
-	char* pBuffer = nullptr;
-	
-	//only allocate it if there's a compression defined
-	if (m_pCompression)
+	for (size_t i = 0; i < m_keyValues.size(); i++)
 	{
-		//allocating just the largest mipmap would be enough for the smallest one
-		pBuffer = (char*)malloc(m_pCompression->GetSize((int)m_header.pixelWidth, (int)m_header.pixelHeight));
-	}
+		const string& key = m_keyValues[i].first;
+		const string& value = m_keyValues[i].second;
 
+		uint32_t size = key.size() + 1 + value.size() + 1;
 
-	if (m_pCompression)
-	{
-		cout << "Compressing with " << m_pCompression->GetName() << endl;
+		file.write((const char*)&size, sizeof(uint32_t));
+		file.write(key.c_str(), key.size() + 1);
+		file.write(value.c_str(), value.size() + 1);
+
+		file.write((const char*)&dummy, 3 - ((size + 3) % 4));
 	}
 
 
 	for (size_t m = 0; m < m_mipmaps.size(); m++)
 	{
 		const MipmapLevel& mmp = m_mipmaps[m];
+
+		//the rows are padded to 4 bytes (GL_UNPACK_ALIGNMENT), the faces are 
+		//stored packed so the odd sizes are written row by row
+		const uint32_t rowSize = mmp.w * m_comp;
+		const uint32_t rowPadding = 3 - ((rowSize + 3) % 4);
 	
-		uint32_t imgSize = (mmp.w * mmp.h) * m_comp;
+		uint32_t imgSize = (rowSize + rowPadding) * mmp.h;
 
 
 		//if compressed set the fixed size 
@@ -417,19 +678,32 @@ bool Container::Write(const char* filePath) const
 
 				const Face& face = mmp.elems[e][f];
 
-				const char* pData = (char*)face.pData;
-				size_t size = imgSize;
+				const char* pData = (char*)face.data.Get();
 				
 				//if ha compression then write the compressed data instead
 				if (m_pCompression)
 				{
-					pData = pBuffer;
-					size = m_pCompression->Compress(face.pData, pBuffer, mmp.w, mmp.h, m_format, m_depth);
+					pData = (const char*)face.compressed.Get();
 
-					assert(imgSize == size);
+					assert(imgSize == face.compressed.GetSize());
+
+					file.write(pData, imgSize);
+				}
+				else if (rowPadding == 0)
+				{
+					file.write(pData, imgSize);
+				}
+				else
+				{
+					for (int y = 0; y < mmp.h; y++)
+					{
+						file.write(pData + y * rowSize, rowSize);
+						file.write((const char*)&dummy, rowPadding);
+					}
 				}
 
-				file.write(pData, size);
+				face.data.Evict();
+				face.compressed.Evict();
 			}
 		}
 
@@ -438,16 +712,14 @@ bool Container::Write(const char* filePath) const
 		file.write((const char*)&dummy, mipmapPadding);
 	}
 
-	file.close();
-
-	if (pBuffer)
+	if (!file.good())
 	{
-		assert(m_pCompression != nullptr);
-		free(pBuffer);
+		cout << "Couldn't write '" << filePath << "'" << endl;
+		file.close();
+		return false;
 	}
 
-	
-	cout << "Writing ktx container to " << filePath << endl;
+	file.close();
 
 	return true;
 }
@@ -30,7 +30,11 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <vector>
+#include <string>
+#include <utility>
 #include <Types.h>
+#include <Buffer.h>
+#include <ImageView.h>
 
 
 
@@ -38,6 +42,7 @@
 
 class Compression;
 class PixelData;
+class FilterTable;
 
 
 
@@ -78,7 +83,11 @@ public:
 
 	struct Face
 	{
-		void* pData;
+		/** The pixels in the container format, owned by the face */
+		Buffer data;
+
+		/** The compressed data, filled by Encode. Empty if there's no compression */
+		Buffer compressed;
 	};
 
 	typedef std::vector<Face> FaceArray;
@@ -109,11 +118,27 @@ protected:
 	Format        m_format;
 	ColorDepth    m_depth;
 	int           m_comp;
+	bool          m_encoded;
+
+	Arena*        m_pArena;
+
+	MipFilter     m_mipFilter;
+
+	ColorTransform m_colorTransform;
+	bool          m_premultiply;
+
+	/** Written after the header, in order */
+	std::vector<std::pair<std::string, std::string> > m_keyValues;
 
 
-	/** Downsamples the pixel data. The final size will be half of the dimmesion provided.
-	 *  This also performs an average filter. */
-	void* Downsample(void* pData, int w, int h);
+	/** Generates the levels of a face from the level 0. The levels [0, boxLevels)
+	 *  are reduced with the 2x2 box filter, the rest with the filter tables of
+	 *  their width and height. The levels are allocated here */
+	void GenerateChain(int elemIndex, int faceIndex, int boxLevels, const FilterTable* const* pWidthTables, const FilterTable* const* pHeightTables);
+
+
+	/** View of the pixels of a face in the level, top-down as stored */
+	ImageView GetView(const MipmapLevel& mmp, int elemIndex, int faceIndex) const;
 
 
 	/** Writes a mipmap face to a text PPM file for debugging purposes */
@@ -128,6 +153,11 @@ public:
 
 
 
+	/** Frees the compression object, the faces free their own pixels */
+	~Container();
+
+
+
 	/** Checks the header for the identifier, assuming this was loaded from file */
 	bool HasValidIdentifier() const;
 
@@ -142,6 +172,20 @@ public:
 
 
 
+	/** The buffers of the levels (and the compressed data) are allocated from
+	 *  the arena, then the container must not outlive it. Must be called before
+	 *  SetData, NULL uses the heap */
+	void SetArena(Arena* pArena) { m_pArena = pArena; }
+
+
+
+
+	/** Filter used to generate the mipmaps, box by default */
+	void SetMipFilter(MipFilter filter) { m_mipFilter = filter; }
+
+
+
+
 	/** Sets the format, color depth and compression. This must be called before
 	 *  SetData. This method takes ownership of the compression object. */
 	void SetFormat(Format format, ColorDepth depth, Compression* pComp = NULL);
@@ -149,49 +193,69 @@ public:
 
 
 
+	/** Colour conversion done by SetData along with the 8-bit conversion, the 
+	 *  transfer function and/or alpha premultiplication (ignored without alpha).
+	 *  The matching key/values are added (ColorSpace, PremultipliedAlpha) and
+	 *  uncompressed sRGB output uses the sRGB internal formats. This must be
+	 *  called after SetFormat and before SetData. */
+	void SetColorConversion(ColorTransform transform, bool premultiply);
+
+
+
+
+	/** Adds a key/value pair to the metadata of the file, both null terminated */
+	void AddKeyValue(const std::string& key, const std::string& value);
+
+
+
+
 	/** This allocates and sets the pixel data in its final format. 
 	 *  The format and compression should be defined before calling 
-	 *  this method. */
-	void SetData(int elementIndex, int faceIndex, PixelData* pData);
+	 *  this method. The pixel data is consumed, 8-bit samples are already
+	 *  in the final format so their buffer is adopted instead of copied 
+	 *  (and converted in place if there's a colour conversion). 
+	 *  flipY turns the image upside down. */
+	void SetData(int elementIndex, int faceIndex, PixelData&& data, bool flipY = false);
 
 
 
 	
-	/** Generates mipmaps if the dimmensions allows it. Even tho some devices support
-	 *  non-power of 2 mipmaps, this method does not support it to discourage bad art 
-	 *  practices. */
-	void GenerateMipmaps();
+	/** Generates the whole mipmap chain with the GL sizes, each level half the 
+	 *  previous one rounded down (at least 1) down to 1x1, non power of 2 and non
+	 *  square images as well. When dumpMipmaps is set every level is also written
+	 *  as a ppm file. */
+	void GenerateMipmaps(bool dumpMipmaps = false);
 
 	
 
-	
-	/** Writes the ktx container to file. If there's an issue writing the file
-	 *  it will return false */
-	bool Write(const char* filePath) const;
+	/** Compresses every level, element and face into its own buffer, all of them
+	 *  at once. This must be called after GenerateMipmaps and before Write, the
+	 *  compressed data is kept until the pixel data changes. */
+	void Encode();
 
 
 
 
-	/** Reads the container from a file. This will call init and initialize 
-	 *  everything up */
-	bool Read(const char* filePath) const;
+	/** Checks if the container data is ready to be written */
+	inline bool IsEncoded() const { return m_encoded; }
 
 
 
+	/** The levels with the pixels of every face, read only */
+	inline const MipmapArray& GetMipmaps() const { return m_mipmaps; }
 
 
-	/** Checks if the dimmension is square and power of 2 */
-	inline bool IsSqrPowerOf2()
-	{
-		int w = m_header.pixelWidth;
-		int h = m_header.pixelHeight;
+	
+	/** Writes the ktx container to file, only I/O is performed here so Encode must 
+	 *  be called first. If there's an issue writing the file it will return false */
+	bool Write(const char* filePath) const;
 
-		assert(w != 0 && h !=0);
 
-		if (w != h) return false;
 
-		return w > 0 && !(w & (w - 1));
-	}
+
+	/** Reads the container from a file. This will call init and initialize 
+	 *  everything up */
+	bool Read(const char* filePath) const;
 
 
 
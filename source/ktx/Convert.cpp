@@ -0,0 +1,351 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+#include "Convert.h"
+#include <assert.h>
+#include <math.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+
+#define KTXTOOL_X86
+#include <immintrin.h>
+
+#endif
+
+
+
+
+
+/** The reference, the SIMD kernels do exactly the same operations */
+static inline uint8_t FloatToUnorm8(float v)
+{
+	//NaNs fail the comparison so they become zero
+	v = v > 0.f ? v : 0.f;
+	v = v < 1.f ? v : 1.f;
+
+	return (uint8_t)(v * 255.f + 0.5f);
+}
+
+static void ConvertScalar(const float* pIn, uint8_t* pOut, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		pOut[i] = FloatToUnorm8(pIn[i]);
+	}
+}
+
+
+
+
+#ifdef KTXTOOL_X86
+
+
+/** Clamps, scales and rounds 4 floats. Max returns the second operand if any
+ *  is a NaN, so NaNs become zero */
+__attribute__((target("sse2")))
+static inline __m128i ConvertSSE2x4(const float* p)
+{
+	__m128 v = _mm_loadu_ps(p);
+
+	v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.f));
+	v = _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.f)), _mm_set1_ps(0.5f));
+
+	return _mm_cvttps_epi32(v);
+}
+
+/** 16 floats per iteration, 4 registers packed into one */
+__attribute__((target("sse2")))
+static void ConvertSSE2(const float* pIn, uint8_t* pOut, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i a = ConvertSSE2x4(pIn + i);
+		__m128i b = ConvertSSE2x4(pIn + i + 4);
+		__m128i c = ConvertSSE2x4(pIn + i + 8);
+		__m128i d = ConvertSSE2x4(pIn + i + 12);
+
+		//the values are already in [0, 255] so the saturation doesn't change them
+		__m128i ab = _mm_packs_epi32(a, b);
+		__m128i cd = _mm_packs_epi32(c, d);
+
+		_mm_storeu_si128((__m128i*)(pOut + i), _mm_packus_epi16(ab, cd));
+	}
+
+	ConvertScalar(pIn + i, pOut + i, count - i);
+}
+
+
+/** Same as ConvertSSE2x4 with 8 floats */
+__attribute__((target("avx2")))
+static inline __m256i ConvertAVX2x8(const float* p)
+{
+	__m256 v = _mm256_loadu_ps(p);
+
+	v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+	v = _mm256_add_ps(_mm256_mul_ps(v, _mm256_set1_ps(255.f)), _mm256_set1_ps(0.5f));
+
+	return _mm256_cvttps_epi32(v);
+}
+
+/** 32 floats per iteration, same as SSE2 but the packs work per 128 bit 
+ *  lane so the dwords are shuffled back in order at the end */
+__attribute__((target("avx2")))
+static void ConvertAVX2(const float* pIn, uint8_t* pOut, size_t count)
+{
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	size_t i = 0;
+
+	for (; i + 32 <= count; i += 32)
+	{
+		__m256i a = ConvertAVX2x8(pIn + i);
+		__m256i b = ConvertAVX2x8(pIn + i + 8);
+		__m256i c = ConvertAVX2x8(pIn + i + 16);
+		__m256i d = ConvertAVX2x8(pIn + i + 24);
+
+		__m256i ab = _mm256_packs_epi32(a, b);
+		__m256i cd = _mm256_packs_epi32(c, d);
+
+		__m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(ab, cd), order);
+
+		_mm256_storeu_si256((__m256i*)(pOut + i), bytes);
+	}
+
+	ConvertSSE2(pIn + i, pOut + i, count - i);
+}
+
+
+#endif
+
+
+
+
+bool IsConvertKernelSupported(ConvertKernel kernel)
+{
+	switch (kernel)
+	{
+	case CONVERT_SCALAR: return true;
+
+#ifdef KTXTOOL_X86
+	case CONVERT_SSE2:   return __builtin_cpu_supports("sse2");
+	case CONVERT_AVX2:   return __builtin_cpu_supports("avx2");
+#endif
+
+	default:             return false;
+	}
+}
+
+ConvertKernel GetConvertKernel()
+{
+	static ConvertKernel best = []()
+	{
+		if (IsConvertKernelSupported(CONVERT_AVX2))
+		{
+			return CONVERT_AVX2;
+		}
+		
+		if (IsConvertKernelSupported(CONVERT_SSE2))
+		{
+			return CONVERT_SSE2;
+		}
+
+		return CONVERT_SCALAR;
+	}();
+
+	return best;
+}
+
+const char* GetConvertKernelName(ConvertKernel kernel)
+{
+	switch (kernel)
+	{
+	case CONVERT_SCALAR: return "scalar";
+	case CONVERT_SSE2:   return "sse2";
+	case CONVERT_AVX2:   return "avx2";
+	default:             return "unknown";
+	}
+}
+
+void ConvertFloatToUnorm8(const float* pIn, uint8_t* pOut, size_t count)
+{
+	ConvertFloatToUnorm8(pIn, pOut, count, GetConvertKernel());
+}
+
+void ConvertFloatToUnorm8(const float* pIn, uint8_t* pOut, size_t count, ConvertKernel kernel)
+{
+	assert(IsConvertKernelSupported(kernel));
+
+	switch (kernel)
+	{
+#ifdef KTXTOOL_X86
+	case CONVERT_SSE2: ConvertSSE2(pIn, pOut, count); break;
+	case CONVERT_AVX2: ConvertAVX2(pIn, pOut, count); break;
+#endif
+	default:           ConvertScalar(pIn, pOut, count); break;
+	}
+}
+
+
+
+
+static float SRGBToLinear(float v)
+{
+	return v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSRGB(float v)
+{
+	return v <= 0.0031308f ? v * 12.92f : 1.055f * powf(v, 1.f / 2.4f) - 0.055f;
+}
+
+ColorConverter::ColorConverter(ColorTransform transform, bool premultiply, int comp)
+{
+	m_transform = transform;
+	m_premultiply = premultiply && comp == 4;
+	m_comp = comp;
+
+	auto Transform = [transform](float v)
+	{
+		switch (transform)
+		{
+		case COLOR_TRANSFORM_SRGB_TO_LINEAR: return SRGBToLinear(v);
+		case COLOR_TRANSFORM_LINEAR_TO_SRGB: return LinearToSRGB(v);
+		default:                             return v;
+		}
+	};
+
+	for (int i = 0; i <= LUT_SIZE; i++)
+	{
+		m_lut[i] = Transform((float)i / LUT_SIZE);
+	}
+
+	for (int i = 0; i < 256; i++)
+	{
+		m_floats[i] = Transform(i / 255.f);
+		m_bytes[i] = FloatToUnorm8(m_floats[i]);
+	}
+}
+
+void ColorConverter::Apply(float* pSamples, size_t count) const
+{
+	assert(count % m_comp == 0);
+
+	//the alpha is never transformed
+	const int colors = m_comp == 4 ? 3 : m_comp;
+
+	for (size_t i = 0; i < count; i += m_comp)
+	{
+		float* pixel = pSamples + i;
+
+		float alpha = 1.f;
+
+		if (m_premultiply)
+		{
+			alpha = pixel[3] > 0.f ? (pixel[3] < 1.f ? pixel[3] : 1.f) : 0.f;
+		}
+
+		for (int c = 0; c < colors; c++)
+		{
+			//NaNs fail the comparison so they become zero
+			float v = pixel[c] > 0.f ? (pixel[c] < 1.f ? pixel[c] : 1.f) : 0.f;
+
+			switch (m_transform)
+			{
+			case COLOR_TRANSFORM_SRGB_TO_LINEAR:
+				v = Lookup(v) * alpha;
+				break;
+			case COLOR_TRANSFORM_LINEAR_TO_SRGB:
+				v = Lookup(v * alpha);
+				break;
+			default:
+				v = v * alpha;
+				break;
+			}
+
+			pixel[c] = v;
+		}
+	}
+}
+
+void ColorConverter::Apply(const uint8_t* pIn, uint8_t* pOut, size_t count) const
+{
+	assert(count % m_comp == 0);
+
+	if (!m_premultiply)
+	{
+		//the alpha, if any, maps to itself
+		uint8_t alphaTable[256];
+
+		const uint8_t* tables[4] = { m_bytes, m_bytes, m_bytes, m_bytes };
+
+		if (m_comp == 4)
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				alphaTable[i] = i;
+			}
+
+			tables[3] = alphaTable;
+		}
+
+		for (size_t i = 0; i < count; i += m_comp)
+		{
+			for (int c = 0; c < m_comp; c++)
+			{
+				pOut[i + c] = tables[c][pIn[i + c]];
+			}
+		}
+
+		return;
+	}
+
+	//premultiplied, only with alpha. Same operations as the float version
+	assert(m_comp == 4);
+
+	for (size_t i = 0; i < count; i += 4)
+	{
+		const uint8_t a = pIn[i + 3];
+		const float alpha = a / 255.f;
+
+		for (int c = 0; c < 3; c++)
+		{
+			float v;
+
+			switch (m_transform)
+			{
+			case COLOR_TRANSFORM_SRGB_TO_LINEAR:
+				v = m_floats[pIn[i + c]] * alpha;
+				break;
+			case COLOR_TRANSFORM_LINEAR_TO_SRGB:
+				v = Lookup(pIn[i + c] / 255.f * alpha);
+				break;
+			default:
+				v = pIn[i + c] / 255.f * alpha;
+				break;
+			}
+
+			pOut[i + c] = FloatToUnorm8(v);
+		}
+
+		pOut[i + 3] = a;
+	}
+}
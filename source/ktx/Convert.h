@@ -0,0 +1,150 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+#ifndef __KTXTOOL_CONVERT_INCLUDED
+#define __KTXTOOL_CONVERT_INCLUDED
+
+
+
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <Types.h>
+
+
+
+
+
+/** Sample conversion kernels used when the decoded type doesn't match the 
+ *  container format. There's a scalar version of each one and SIMD versions
+ *  (SSE2, AVX2) picked at runtime for the cpu, all give the same results. */
+
+enum ConvertKernel
+{
+	CONVERT_SCALAR,
+	CONVERT_SSE2,
+	CONVERT_AVX2,
+
+	CONVERT_KERNEL_COUNT
+};
+
+
+
+
+/** Returns the fastest kernel supported by the cpu */
+ConvertKernel GetConvertKernel();
+
+
+
+
+/** Returns false if the kernel is not supported by the cpu (or the build) */
+bool IsConvertKernelSupported(ConvertKernel kernel);
+
+
+
+
+const char* GetConvertKernelName(ConvertKernel kernel);
+
+
+
+
+/** Converts [0, 1] floats into unorm8, rounded to nearest and saturated,
+ *  NaNs are converted to zero. Uses the fastest kernel available. */
+void ConvertFloatToUnorm8(const float* pIn, uint8_t* pOut, size_t count);
+
+
+
+
+/** Same as above with a given kernel, which must be supported */
+void ConvertFloatToUnorm8(const float* pIn, uint8_t* pOut, size_t count, ConvertKernel kernel);
+
+
+
+
+
+/** Colour conversion of normalized float pixels, done right before they are
+ *  converted into unorm8 so it doesn't take a pass of its own. The transfer 
+ *  functions are tabulated (interpolated, far below half an 8-bit step) and
+ *  the alpha is premultiplied in linear space: after sRGB to linear, before
+ *  linear to sRGB. Values are clamped to [0, 1]. */
+class ColorConverter
+{
+	static const int LUT_SIZE = 4096;
+
+	float          m_lut[LUT_SIZE + 1];
+
+	/** The whole conversion of each unorm8 value (without premultiplication),
+	 *  and the value transformed as a float to premultiply it */
+	uint8_t        m_bytes[256];
+	float          m_floats[256];
+
+	ColorTransform m_transform;
+	bool           m_premultiply;
+	int            m_comp;
+
+	inline float Lookup(float v) const
+	{
+		//also NaNs
+		if (!(v > 0.f))
+		{
+			return m_lut[0];
+		}
+
+		if (v >= 1.f)
+		{
+			return m_lut[LUT_SIZE];
+		}
+
+		float pos = v * LUT_SIZE;
+		int i = (int)pos;
+
+		return m_lut[i] + (m_lut[i + 1] - m_lut[i]) * (pos - i);
+	}
+
+public:
+
+
+	/** Premultiplies only if there's alpha (4 components) */
+	ColorConverter(ColorTransform transform, bool premultiply, int comp);
+
+
+	/** Nothing to do, the pixels can be converted as they are */
+	bool IsIdentity() const { return m_transform == COLOR_TRANSFORM_NONE && !m_premultiply; }
+
+
+	/** Converts count samples in place, whole pixels */
+	void Apply(float* pSamples, size_t count) const;
+
+
+	/** Same for unorm8 samples, pOut can be pIn. Without premultiplication each
+	 *  byte is just looked up, the transfer functions are exact there */
+	void Apply(const uint8_t* pIn, uint8_t* pOut, size_t count) const;
+};
+
+
+
+
+
+
+
+
+
+
+#endif
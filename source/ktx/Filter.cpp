@@ -0,0 +1,767 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+
+#include "Filter.h"
+#include <Parallel.h>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+
+#define KTXTOOL_X86
+#include <immintrin.h>
+
+#endif
+
+
+
+
+
+using namespace std;
+
+
+
+
+
+/** Bytes of floats of the source rows filtered at once, the strips are at 
+ *  least STRIP_MIN_ROWS output rows anyway so the taps shared between strips
+ *  are not filtered twice too often */
+static const size_t STRIP_BYTES = 512 << 10;
+static const int    STRIP_MIN_ROWS = 16;
+
+
+
+
+static const struct 
+{
+	const char* name;
+	MipFilter   filter;
+}
+filterNames[] =
+{
+	{ "box",      MIP_FILTER_BOX },
+	{ "kaiser",   MIP_FILTER_KAISER },
+	{ "lanczos3", MIP_FILTER_LANCZOS3 },
+	{ "mitchell", MIP_FILTER_MITCHELL }
+};
+
+bool GetMipFilter(const char* name, MipFilter& filter)
+{
+	for (size_t i = 0; i < sizeof(filterNames) / sizeof(filterNames[0]); i++)
+	{
+		if (strcmp(name, filterNames[i].name) == 0)
+		{
+			filter = filterNames[i].filter;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char* GetMipFilterName(MipFilter filter)
+{
+	for (size_t i = 0; i < sizeof(filterNames) / sizeof(filterNames[0]); i++)
+	{
+		if (filterNames[i].filter == filter)
+		{
+			return filterNames[i].name;
+		}
+	}
+
+	return "unknown";
+}
+
+
+
+
+static double Sinc(double x)
+{
+	if (fabs(x) < 1e-9)
+	{
+		return 1.0;
+	}
+
+	x *= M_PI;
+
+	return sin(x) / x;
+}
+
+/** Modified Bessel function of the first kind, order 0 (the series) */
+static double BesselI0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+
+	for (int k = 1; k < 32; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+
+	return sum;
+}
+
+/** Half width of the filter, in destination pixels */
+static int GetSupport(MipFilter filter)
+{
+	switch (filter)
+	{
+	case MIP_FILTER_MITCHELL: return 2;
+	case MIP_FILTER_KAISER:
+	case MIP_FILTER_LANCZOS3: return 3;
+	default:                  return 1;
+	}
+}
+
+/** The filter at x destination pixels from the center */
+static double Evaluate(MipFilter filter, double x)
+{
+	x = fabs(x);
+
+	switch (filter)
+	{
+	case MIP_FILTER_KAISER:
+	{
+		const double width = 3.0;
+		const double alpha = 4.0;
+
+		if (x >= width)
+		{
+			return 0.0;
+		}
+
+		double t = x / width;
+
+		return Sinc(x) * BesselI0(alpha * sqrt(1.0 - t * t)) / BesselI0(alpha);
+	}
+	case MIP_FILTER_LANCZOS3:
+	{
+		return x < 3.0 ? Sinc(x) * Sinc(x / 3.0) : 0.0;
+	}
+	case MIP_FILTER_MITCHELL:
+	{
+		//B = C = 1/3
+		const double B = 1.0 / 3.0;
+		const double C = 1.0 / 3.0;
+
+		if (x < 1.0)
+		{
+			return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6.0;
+		}
+
+		if (x < 2.0)
+		{
+			return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6.0;
+		}
+
+		return 0.0;
+	}
+	default:
+		return x < 1.0 ? 1.0 : 0.0;
+	}
+}
+
+
+
+
+FilterTable::FilterTable(MipFilter filter, int srcSize)
+{
+	const int support = GetSupport(filter);
+
+	m_srcSize = srcSize;
+	m_dstSize = max(1, srcSize / 2);
+
+	//source pixels per output, 2 for the even sizes, a bit more for the odd ones
+	const double scale = (double)srcSize / m_dstSize;
+
+	m_uniform = filter != MIP_FILTER_BOX && srcSize == m_dstSize * 2;
+
+	if (m_uniform)
+	{
+		//the source pixels within the support, two per destination pixel
+		m_taps = support * 4;
+	}
+	else if (filter == MIP_FILTER_BOX)
+	{
+		//the source pixels the output covers, partially at both ends
+		m_taps = (int)ceil(scale) + 1;
+	}
+	else
+	{
+		//the source pixels within the support, scaled
+		m_taps = (int)ceil(support * scale * 2.0) + 1;
+	}
+
+	assert(m_taps <= MAX_TAPS);
+
+	m_indices.resize(m_dstSize * m_taps);
+	m_weights.resize(m_dstSize * m_taps);
+
+	for (int i = 0; i < m_dstSize; i++)
+	{
+		//the center of the output pixel, in source pixels
+		const double center = (i + 0.5) * scale - 0.5;
+
+		int first;
+
+		if (m_uniform)
+		{
+			first = 2 * i - (support * 2 - 1);
+		}
+		else if (filter == MIP_FILTER_BOX)
+		{
+			first = (int)floor(i * scale);
+		}
+		else
+		{
+			first = (int)floor(center - support * scale) + 1;
+		}
+
+		int* pIndices = &m_indices[i * m_taps];
+		float* pWeights = &m_weights[i * m_taps];
+
+		double weights[MAX_TAPS];
+		double sum = 0.0;
+
+		for (int k = 0; k < m_taps; k++)
+		{
+			const int j = first + k;
+
+			if (filter == MIP_FILTER_BOX)
+			{
+				//the part of the source pixel [j, j + 1) under the output
+				weights[k] = max(0.0, min(j + 1.0, (i + 1) * scale) - max((double)j, i * scale));
+			}
+			else
+			{
+				weights[k] = Evaluate(filter, (j - center) / scale);
+			}
+
+			sum += weights[k];
+
+			pIndices[k] = min(max(j, 0), srcSize - 1);
+		}
+
+		for (int k = 0; k < m_taps; k++)
+		{
+			pWeights[k] = (float)(weights[k] / sum);
+		}
+	}
+}
+
+
+
+
+/** Splits a source row into its even and odd pixels normalized to [0, 1], pad 
+ *  pixels before and after are repeated from the edges */
+template<int COMP>
+static inline void SplitEdge(const uint8_t* pIn, float* pEven, float* pOdd, int pad, int first, int end, int last)
+{
+	for (int p = first; p < end; p++)
+	{
+		const int x = (p - pad) * 2;
+
+		const uint8_t* e = pIn + min(max(x, 0), last) * COMP;
+		const uint8_t* o = pIn + min(max(x + 1, 0), last) * COMP;
+
+		for (int c = 0; c < COMP; c++)
+		{
+			pEven[p * COMP + c] = e[c] * (1.f / 255.f);
+			pOdd[p * COMP + c] = o[c] * (1.f / 255.f);
+		}
+	}
+}
+
+template<int COMP>
+static void SplitRow(const uint8_t* pIn, float* pEven, float* pOdd, int pad, int count, int last)
+{
+	//the pixel pairs fully inside the row, the rest is clamped
+	const int end = pad + (last + 1) / 2;
+
+	SplitEdge<COMP>(pIn, pEven, pOdd, pad, 0, pad, last);
+
+	for (int p = pad; p < end; p++)
+	{
+		const uint8_t* pSrc = pIn + (p - pad) * 2 * COMP;
+
+		for (int c = 0; c < COMP; c++)
+		{
+			pEven[p * COMP + c] = pSrc[c] * (1.f / 255.f);
+			pOdd[p * COMP + c] = pSrc[COMP + c] * (1.f / 255.f);
+		}
+	}
+
+	SplitEdge<COMP>(pIn, pEven, pOdd, pad, end, count, last);
+}
+
+
+
+
+/** The horizontal pass of a source row with its own taps per output, the odd
+ *  sizes. Normalized to [0, 1] */
+template<int COMP>
+static void GatherRow(const uint8_t* pIn, float* pOut, const FilterTable& table)
+{
+	const int taps = table.GetTaps();
+
+	for (int x = 0; x < table.GetSize(); x++)
+	{
+		const int* pIndices = table.GetIndices(x);
+		const float* pWeights = table.GetWeights(x);
+
+		float acc[COMP] = {};
+
+		for (int k = 0; k < taps; k++)
+		{
+			const uint8_t* pPixel = pIn + pIndices[k] * COMP;
+
+			for (int c = 0; c < COMP; c++)
+			{
+				acc[c] += pWeights[k] * pPixel[c];
+			}
+		}
+
+		for (int c = 0; c < COMP; c++)
+		{
+			pOut[x * COMP + c] = acc[c] * (1.f / 255.f);
+		}
+	}
+}
+
+
+
+
+/** The horizontal pass of a source row, normalized to [0, 1]. The outputs are
+ *  2 source pixels apart, so the source is split into its even and odd pixels
+ *  (the edges repeated) and each tap becomes a contiguous run of one of them,
+ *  then the taps are added as the rows of the vertical pass. The odd sizes
+ *  are gathered instead */
+static void FilterRow(const uint8_t* pIn, float* pOut, int comp, const FilterTable& table, vector<float>& even, vector<float>& odd)
+{
+	if (!table.IsUniform())
+	{
+		switch (comp)
+		{
+		case 1:  GatherRow<1>(pIn, pOut, table); break;
+		case 3:  GatherRow<3>(pIn, pOut, table); break;
+		default: GatherRow<4>(pIn, pOut, table); break;
+		}
+
+		return;
+	}
+
+	const int taps = table.GetTaps();
+	const int size = table.GetSize();
+	const int last = table.GetSourceSize() - 1;
+
+	//the taps of an output reach this many pixels of each half beyond it
+	const int pad = taps / 4;
+	const int count = size + pad * 2;
+
+	even.resize(count * comp);
+	odd.resize(count * comp);
+
+	switch (comp)
+	{
+	case 1:  SplitRow<1>(pIn, &even[0], &odd[0], pad, count, last); break;
+	case 3:  SplitRow<3>(pIn, &even[0], &odd[0], pad, count, last); break;
+	default: SplitRow<4>(pIn, &even[0], &odd[0], pad, count, last); break;
+	}
+
+	//the first tap is the odd pixel pad to the left, then even and odd in turns
+	const float* rows[FilterTable::MAX_TAPS];
+
+	for (int k = 0; k < taps; k++)
+	{
+		const int d = k - (pad * 2 - 1);
+
+		rows[k] = d % 2 == 0 ? &even[(d / 2 + pad) * comp] : &odd[((d - 1) / 2 + pad) * comp];
+	}
+
+	//the weights are the same for every output (a single phase), only the taps 
+	//out of the image differ and those are in the repeated edges
+	FilterColumns(rows, table.GetWeights(0), taps, pOut, size * comp);
+}
+
+
+
+
+static void FilterColumnsScalar(const float* const* pRows, const float* pWeights, int taps, float* pOut, size_t first, size_t count)
+{
+	for (size_t i = first; i < count; i++)
+	{
+		float acc = 0.f;
+
+		for (int k = 0; k < taps; k++)
+		{
+			acc += pWeights[k] * pRows[k][i];
+		}
+
+		pOut[i] = acc;
+	}
+}
+
+
+#ifdef KTXTOOL_X86
+
+
+/** 4 columns at a time, multiplies and adds (no fma) so it matches the scalar code */
+__attribute__((target("sse2")))
+static void FilterColumnsSSE2(const float* const* pRows, const float* pWeights, int taps, float* pOut, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 acc = _mm_setzero_ps();
+
+		for (int k = 0; k < taps; k++)
+		{
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(pWeights[k]), _mm_loadu_ps(pRows[k] + i)));
+		}
+
+		_mm_storeu_ps(pOut + i, acc);
+	}
+
+	FilterColumnsScalar(pRows, pWeights, taps, pOut, i, count);
+}
+
+/** 16 columns at a time, two registers so the adds of a tap don't wait for each other */
+__attribute__((target("avx2")))
+static void FilterColumnsAVX2(const float* const* pRows, const float* pWeights, int taps, float* pOut, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256 a = _mm256_setzero_ps();
+		__m256 b = _mm256_setzero_ps();
+
+		for (int k = 0; k < taps; k++)
+		{
+			__m256 w = _mm256_set1_ps(pWeights[k]);
+
+			a = _mm256_add_ps(a, _mm256_mul_ps(w, _mm256_loadu_ps(pRows[k] + i)));
+			b = _mm256_add_ps(b, _mm256_mul_ps(w, _mm256_loadu_ps(pRows[k] + i + 8)));
+		}
+
+		_mm256_storeu_ps(pOut + i, a);
+		_mm256_storeu_ps(pOut + i + 8, b);
+	}
+
+	FilterColumnsScalar(pRows, pWeights, taps, pOut, i, count);
+}
+
+
+#endif
+
+
+
+
+void FilterColumns(const float* const* pRows, const float* pWeights, int taps, float* pOut, size_t count)
+{
+	FilterColumns(pRows, pWeights, taps, pOut, count, GetConvertKernel());
+}
+
+void FilterColumns(const float* const* pRows, const float* pWeights, int taps, float* pOut, size_t count, ConvertKernel kernel)
+{
+	assert(IsConvertKernelSupported(kernel));
+
+	switch (kernel)
+	{
+#ifdef KTXTOOL_X86
+	case CONVERT_SSE2: FilterColumnsSSE2(pRows, pWeights, taps, pOut, count); break;
+	case CONVERT_AVX2: FilterColumnsAVX2(pRows, pWeights, taps, pOut, count); break;
+#endif
+	default:           FilterColumnsScalar(pRows, pWeights, taps, pOut, 0, count); break;
+	}
+}
+
+
+
+
+/** The buffers of a strip, one set per thread so the strips don't allocate */
+struct StripScratch
+{
+	vector<float>        strip;
+	vector<float>        even;
+	vector<float>        odd;
+	vector<float>        acc;
+	vector<const float*> rows;
+};
+
+static thread_local StripScratch stripScratch;
+
+
+/** Output rows per strip, the source rows under them fit in STRIP_BYTES */
+static int GetStripRows(const ImageView& dst, int comp, const FilterTable& heightTable)
+{
+	const size_t rowSize = (size_t)dst.w * comp;
+	const int fit = (int)(STRIP_BYTES / (rowSize * sizeof(float))) - (heightTable.GetTaps() - 2);
+
+	return max(STRIP_MIN_ROWS, fit / 2);
+}
+
+/** The source rows under the output rows [first, last), the taps are clamped so they are in order */
+static inline void GetStripSource(const FilterTable& heightTable, int first, int last, int& srcFirst, int& srcLast)
+{
+	srcFirst = heightTable.GetIndices(first)[0];
+	srcLast = heightTable.GetIndices(last - 1)[heightTable.GetTaps() - 1];
+}
+
+/** Filters the output rows [first, last) of dst */
+static void FilterStrip(const ImageView& src, const ImageView& dst, int comp, const FilterTable& widthTable, const FilterTable& heightTable, int first, int last)
+{
+	StripScratch& scratch = stripScratch;
+
+	const int taps = heightTable.GetTaps();
+	const size_t rowSize = (size_t)dst.w * comp;
+
+	int srcFirst;
+	int srcLast;
+
+	GetStripSource(heightTable, first, last, srcFirst, srcLast);
+
+	scratch.strip.resize((srcLast - srcFirst + 1) * rowSize);
+	scratch.acc.resize(rowSize);
+	scratch.rows.resize(taps);
+
+	for (int y = srcFirst; y <= srcLast; y++)
+	{
+		FilterRow(src.Row(y), &scratch.strip[(y - srcFirst) * rowSize], comp, widthTable, scratch.even, scratch.odd);
+	}
+
+	for (int y = first; y < last; y++)
+	{
+		const int* pIndices = heightTable.GetIndices(y);
+
+		for (int k = 0; k < taps; k++)
+		{
+			scratch.rows[k] = &scratch.strip[(pIndices[k] - srcFirst) * rowSize];
+		}
+
+		FilterColumns(&scratch.rows[0], heightTable.GetWeights(y), taps, &scratch.acc[0], rowSize);
+
+		ConvertFloatToUnorm8(&scratch.acc[0], dst.Row(y), rowSize);
+	}
+}
+
+
+
+
+void FilterDownsample(const ImageView& src, const ImageView& dst, int comp, const FilterTable& widthTable, const FilterTable& heightTable)
+{
+	assert(src.w == widthTable.GetSourceSize() && dst.w == widthTable.GetSize());
+	assert(src.h == heightTable.GetSourceSize() && dst.h == heightTable.GetSize());
+
+	const int stripRows = GetStripRows(dst, comp, heightTable);
+
+	ParallelFor(0, dst.h, stripRows, [&](int first, int last)
+	{
+		for (int begin = first; begin < last; begin += stripRows)
+		{
+			FilterStrip(src, dst, comp, widthTable, heightTable, begin, min(begin + stripRows, last));
+		}
+	});
+}
+
+
+
+
+/** The strips of every level of a chain and which ones are done. A strip 
+ *  starts as soon as the strips of the level above under it are done */
+class FilterChainTasks
+{
+	const ImageView*          m_pLevels;
+	const FilterTable* const* m_pWidthTables;
+	const FilterTable* const* m_pHeightTables;
+	int                       m_count;
+	int                       m_comp;
+
+	/** Per level, the rows of its strips and the index of its first strip */
+	vector<int>               m_stripRows;
+	vector<int>               m_firstStrip;
+
+	unique_ptr<atomic<bool>[]> m_done;
+	unique_ptr<atomic<bool>[]> m_started;
+
+	TaskGroup                 m_group;
+
+
+	FilterChainTasks(const FilterChainTasks&);
+	FilterChainTasks& operator=(const FilterChainTasks&);
+
+
+	inline int GetStripCount(int m) const
+	{
+		return (m_pLevels[m].h + m_stripRows[m] - 1) / m_stripRows[m];
+	}
+
+	/** The strips of the level above (m - 1) under the strip s of the level m */
+	inline void GetParentStrips(int m, int s, int& first, int& last) const
+	{
+		int srcFirst;
+		int srcLast;
+
+		GetStripSource(*m_pHeightTables[m], s * m_stripRows[m], min((s + 1) * m_stripRows[m], m_pLevels[m].h), srcFirst, srcLast);
+
+		first = srcFirst / m_stripRows[m - 1];
+		last = srcLast / m_stripRows[m - 1];
+	}
+
+	/** Starts the strip s of the level m if the rows it reads are done */
+	void TryStart(int m, int s)
+	{
+		const int index = m_firstStrip[m] + s;
+
+		if (m_started[index])
+		{
+			return;
+		}
+
+		//the first level is the source, it's done already
+		if (m > 1)
+		{
+			int first;
+			int last;
+
+			GetParentStrips(m, s, first, last);
+
+			for (int p = first; p <= last; p++)
+			{
+				if (!m_done[m_firstStrip[m - 1] + p])
+				{
+					return;
+				}
+			}
+		}
+
+		//the last parent strips might finish at once, only one of them starts it
+		if (m_started[index].exchange(true))
+		{
+			return;
+		}
+
+		m_group.Run([this, m, s]() { RunStrip(m, s); });
+	}
+
+	void RunStrip(int m, int s)
+	{
+		const int first = s * m_stripRows[m];
+		const int last = min(first + m_stripRows[m], m_pLevels[m].h);
+
+		FilterStrip(m_pLevels[m - 1], m_pLevels[m], m_comp, *m_pWidthTables[m], *m_pHeightTables[m], first, last);
+
+		m_done[m_firstStrip[m] + s] = true;
+
+		if (m + 1 == m_count)
+		{
+			return;
+		}
+
+		//the strips of the next level that read these rows
+		for (int c = 0; c < GetStripCount(m + 1); c++)
+		{
+			int pFirst;
+			int pLast;
+
+			GetParentStrips(m + 1, c, pFirst, pLast);
+
+			if (s >= pFirst && s <= pLast)
+			{
+				TryStart(m + 1, c);
+			}
+		}
+	}
+
+public:
+
+
+	FilterChainTasks(const ImageView* pLevels, int count, int comp, const FilterTable* const* pWidthTables, const FilterTable* const* pHeightTables)
+	{
+		m_pLevels = pLevels;
+		m_pWidthTables = pWidthTables;
+		m_pHeightTables = pHeightTables;
+		m_count = count;
+		m_comp = comp;
+
+		m_stripRows.resize(count);
+		m_firstStrip.resize(count);
+
+		//the source is a single strip, done
+		m_stripRows[0] = pLevels[0].h;
+
+		int strips = 1;
+
+		for (int m = 1; m < count; m++)
+		{
+			m_stripRows[m] = GetStripRows(pLevels[m], comp, *pHeightTables[m]);
+			m_firstStrip[m] = strips;
+
+			strips += GetStripCount(m);
+		}
+
+		m_done.reset(new atomic<bool>[strips]);
+		m_started.reset(new atomic<bool>[strips]);
+
+		for (int i = 0; i < strips; i++)
+		{
+			m_done[i] = i == 0;
+			m_started[i] = i == 0;
+		}
+	}
+
+	void Run()
+	{
+		if (m_count < 2)
+		{
+			return;
+		}
+
+		for (int s = 0; s < GetStripCount(1); s++)
+		{
+			TryStart(1, s);
+		}
+
+		m_group.Wait();
+	}
+};
+
+
+
+
+void FilterChain(const ImageView* pLevels, int count, int comp, const FilterTable* const* pWidthTables, const FilterTable* const* pHeightTables)
+{
+	for (int m = 1; m < count; m++)
+	{
+		assert(pLevels[m - 1].w == pWidthTables[m]->GetSourceSize() && pLevels[m].w == pWidthTables[m]->GetSize());
+		assert(pLevels[m - 1].h == pHeightTables[m]->GetSourceSize() && pLevels[m].h == pHeightTables[m]->GetSize());
+	}
+
+	FilterChainTasks tasks(pLevels, count, comp, pWidthTables, pHeightTables);
+
+	tasks.Run();
+}
@@ -0,0 +1,141 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+#ifndef __KTXTOOL_FILTER_INCLUDED
+#define __KTXTOOL_FILTER_INCLUDED
+
+
+
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <vector>
+#include <Types.h>
+#include <ImageView.h>
+#include "Convert.h"
+
+
+
+
+
+/** Separable filters for the 2:1 mipmap reduction (Kaiser, Lanczos3, Mitchell).
+ *  The weights of every output pixel are computed once per level size, then 
+ *  the images are filtered in strips of rows: a horizontal pass of the source
+ *  rows under the strip into floats, and a vertical pass over the whole rows
+ *  with SIMD multiply-accumulate (the kernels of the conversion). */
+
+
+
+
+
+/** Returns the filter of a name (box, kaiser, lanczos3, mitchell), false if unknown */
+bool GetMipFilter(const char* name, MipFilter& filter);
+
+
+
+
+const char* GetMipFilterName(MipFilter filter);
+
+
+
+
+/** Taps of every output pixel of the reduction of a source dimension to half
+ *  its size, max(1, size / 2). The odd sizes have more than 2 source pixels per
+ *  output and the taps of each output fall at a different phase. The taps out
+ *  of the image are clamped to the edge pixels, and the weights of each output
+ *  are normalized (a flat image stays flat). The box filter is the area of the
+ *  source pixels under the output, it's only used for the odd sizes. */
+class FilterTable
+{
+	int                m_srcSize;
+	int                m_dstSize;
+	int                m_taps;
+	bool               m_uniform;
+
+	/** m_taps source indices and weights per output */
+	std::vector<int>   m_indices;
+	std::vector<float> m_weights;
+
+public:
+
+	static const int MAX_TAPS = 32;
+
+
+	FilterTable(MipFilter filter, int srcSize);
+
+
+	/** An even size (not the box filter), every output has the same weights
+	 *  and its taps start at 2 * i - (taps / 2 - 1) */
+	inline bool IsUniform() const { return m_uniform; }
+
+
+	inline int GetSourceSize() const { return m_srcSize; }
+
+	inline int GetSize() const { return m_dstSize; }
+
+	inline int GetTaps() const { return m_taps; }
+
+	inline const int* GetIndices(int i) const { return &m_indices[i * m_taps]; }
+
+	inline const float* GetWeights(int i) const { return &m_weights[i * m_taps]; }
+};
+
+
+
+
+/** Filters src into dst (half its size) with the tables of the source width
+ *  and height, the same table for both if square. comp is the samples per 
+ *  pixel, 1 (a plane), 3 or 4. Runs in parallel, in strips of rows. */
+void FilterDownsample(const ImageView& src, const ImageView& dst, int comp, const FilterTable& widthTable, const FilterTable& heightTable);
+
+
+
+
+/** Filters every level of a chain from the level above, the level 0 is the 
+ *  source and pWidthTables[m], pHeightTables[m] are the tables of the level m
+ *  (of the size of m - 1). The levels are split in strips of rows and a strip
+ *  runs as soon as the strips of the level above it reads are done, not the
+ *  whole level, so the levels overlap and a strip often reads rows still in
+ *  cache. Runs in parallel */
+void FilterChain(const ImageView* pLevels, int count, int comp, const FilterTable* const* pWidthTables, const FilterTable* const* pHeightTables);
+
+
+
+
+/** The vertical pass, pOut[i] = sum of weights[k] * pRows[k][i] for every tap,
+ *  the taps added in order so every kernel gives the same results */
+void FilterColumns(const float* const* pRows, const float* pWeights, int taps, float* pOut, size_t count);
+
+
+
+
+/** Same as above with a given kernel, which must be supported */
+void FilterColumns(const float* const* pRows, const float* pWeights, int taps, float* pOut, size_t count, ConvertKernel kernel);
+
+
+
+
+
+
+
+
+
+
+#endif
@@ -0,0 +1,329 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+
+#include "Reduce.h"
+#include <Parallel.h>
+#include <assert.h>
+#include <algorithm>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+
+#define KTXTOOL_X86
+#include <immintrin.h>
+
+#endif
+
+
+
+using namespace std;
+
+
+
+/** Rows of the source in a band of ReduceChain, the levels under a band are
+ *  done before the next one starts */
+static const int CHAIN_BAND = 64;
+
+
+
+
+
+/** The reference, output pixels [first, last) */
+template<int COMP>
+static void ReduceScalar(const uint8_t* r0, const uint8_t* r1, uint8_t* pOut, int first, int last)
+{
+	for (int x = first; x < last; x++)
+	{
+		for (int c = 0; c < COMP; c++)
+		{
+			const int i = x * 2 * COMP + c;
+
+			pOut[x * COMP + c] = (r0[i] + r0[i + COMP] + r1[i] + r1[i + COMP] + 2) >> 2;
+		}
+	}
+}
+
+
+
+
+#ifdef KTXTOOL_X86
+
+
+/** Each step reads 16 bytes of both rows but only uses IN of them (whole pixels)
+ *  and writes 8 bytes but only OUT of them are valid, the next step overwrites
+ *  the rest. The last pixels of a row are left to the scalar code */
+template<int COMP>
+struct ReduceStep
+{
+	static const int IN = COMP == 3 ? 12 : 16;
+	static const int OUT = IN / 2;
+};
+
+
+/** The sums of the pixel pairs from the column sums (16 bit) of the first 8 (lo) 
+ *  and the last 8 (hi) bytes of the rows, the OUT valid sums first */
+template<int COMP>
+__attribute__((target("sse2")))
+static inline __m128i SumPairsSSE2(__m128i lo, __m128i hi)
+{
+	if (COMP == 4)
+	{
+		//two pixels per half, the second one shifted over the first
+		lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+		hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+		return _mm_unpacklo_epi64(lo, hi);
+	}
+	else if (COMP == 3)
+	{
+		//the pixels 0 and 1 are the words 0-2 and 3-5, the pixels 2 and 3 are 
+		//the words 6-8 and 9-11 so they cross the halves
+		__m128i s0 = _mm_add_epi16(lo, _mm_srli_si128(lo, 6));
+
+		__m128i p2 = _mm_or_si128(_mm_srli_si128(lo, 12), _mm_slli_si128(hi, 4));
+		__m128i s1 = _mm_add_epi16(p2, _mm_srli_si128(hi, 2));
+
+		const __m128i mask = _mm_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0);
+
+		return _mm_or_si128(_mm_and_si128(s0, mask), _mm_slli_si128(s1, 6));
+	}
+	else
+	{
+		//even and odd words added as dwords, then packed back (the sums fit)
+		__m128i l = _mm_add_epi32(_mm_srli_epi32(_mm_slli_epi32(lo, 16), 16), _mm_srli_epi32(lo, 16));
+		__m128i h = _mm_add_epi32(_mm_srli_epi32(_mm_slli_epi32(hi, 16), 16), _mm_srli_epi32(hi, 16));
+
+		return _mm_packs_epi32(l, h);
+	}
+}
+
+template<int COMP>
+__attribute__((target("sse2")))
+static void ReduceSSE2(const uint8_t* r0, const uint8_t* r1, uint8_t* pOut, int w2)
+{
+	typedef ReduceStep<COMP> Step;
+
+	const int outBytes = w2 * COMP;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+
+	int in = 0;
+	int out = 0;
+
+	for (; out + 8 <= outBytes; in += Step::IN, out += Step::OUT)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(r0 + in));
+		__m128i b = _mm_loadu_si128((const __m128i*)(r1 + in));
+
+		__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+		__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+		__m128i sum = SumPairsSSE2<COMP>(lo, hi);
+
+		sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+
+		_mm_storel_epi64((__m128i*)(pOut + out), _mm_packus_epi16(sum, sum));
+	}
+
+	ReduceScalar<COMP>(r0, r1, pOut, out / COMP, w2);
+}
+
+
+/** Same as SumPairsSSE2, the shifts and packs work per 128 bit lane so each
+ *  lane is a step of its own */
+template<int COMP>
+__attribute__((target("avx2")))
+static inline __m256i SumPairsAVX2(__m256i lo, __m256i hi)
+{
+	if (COMP == 4)
+	{
+		lo = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+		hi = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+
+		return _mm256_unpacklo_epi64(lo, hi);
+	}
+	else if (COMP == 3)
+	{
+		__m256i s0 = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 6));
+
+		__m256i p2 = _mm256_or_si256(_mm256_srli_si256(lo, 12), _mm256_slli_si256(hi, 4));
+		__m256i s1 = _mm256_add_epi16(p2, _mm256_srli_si256(hi, 2));
+
+		const __m256i mask = _mm256_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0, -1, -1, -1, 0, 0, 0, 0, 0);
+
+		return _mm256_or_si256(_mm256_and_si256(s0, mask), _mm256_slli_si256(s1, 6));
+	}
+	else
+	{
+		__m256i l = _mm256_add_epi32(_mm256_srli_epi32(_mm256_slli_epi32(lo, 16), 16), _mm256_srli_epi32(lo, 16));
+		__m256i h = _mm256_add_epi32(_mm256_srli_epi32(_mm256_slli_epi32(hi, 16), 16), _mm256_srli_epi32(hi, 16));
+
+		return _mm256_packs_epi32(l, h);
+	}
+}
+
+/** The bytes of two consecutive steps, one per lane */
+__attribute__((target("avx2")))
+static inline __m256i LoadStepsAVX2(const uint8_t* p, int in)
+{
+	__m128i first = _mm_loadu_si128((const __m128i*)p);
+	__m128i second = _mm_loadu_si128((const __m128i*)(p + in));
+
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(first), second, 1);
+}
+
+/** Two steps per iteration */
+template<int COMP>
+__attribute__((target("avx2")))
+static void ReduceAVX2(const uint8_t* r0, const uint8_t* r1, uint8_t* pOut, int w2)
+{
+	typedef ReduceStep<COMP> Step;
+
+	const int outBytes = w2 * COMP;
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i two = _mm256_set1_epi16(2);
+
+	int in = 0;
+	int out = 0;
+
+	for (; out + Step::OUT + 8 <= outBytes; in += 2 * Step::IN, out += 2 * Step::OUT)
+	{
+		__m256i a = LoadStepsAVX2(r0 + in, Step::IN);
+		__m256i b = LoadStepsAVX2(r1 + in, Step::IN);
+
+		__m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+		__m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+
+		__m256i sum = SumPairsAVX2<COMP>(lo, hi);
+
+		sum = _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+
+		__m256i bytes = _mm256_packus_epi16(sum, sum);
+
+		_mm_storel_epi64((__m128i*)(pOut + out), _mm256_castsi256_si128(bytes));
+		_mm_storel_epi64((__m128i*)(pOut + out + Step::OUT), _mm256_extracti128_si256(bytes, 1));
+	}
+
+	ReduceSSE2<COMP>(r0 + in, r1 + in, pOut + out, w2 - out / COMP);
+}
+
+
+#endif
+
+
+
+
+template<int COMP>
+static void Reduce(const uint8_t* r0, const uint8_t* r1, uint8_t* pOut, int w2, ConvertKernel kernel)
+{
+	switch (kernel)
+	{
+#ifdef KTXTOOL_X86
+	case CONVERT_SSE2: ReduceSSE2<COMP>(r0, r1, pOut, w2); break;
+	case CONVERT_AVX2: ReduceAVX2<COMP>(r0, r1, pOut, w2); break;
+#endif
+	default:           ReduceScalar<COMP>(r0, r1, pOut, 0, w2); break;
+	}
+}
+
+void ReduceRows(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pOut, int w2, int comp)
+{
+	ReduceRows(pRow0, pRow1, pOut, w2, comp, GetConvertKernel());
+}
+
+void ReduceRows(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pOut, int w2, int comp, ConvertKernel kernel)
+{
+	assert(IsConvertKernelSupported(kernel));
+
+	switch (comp)
+	{
+	case 1:  Reduce<1>(pRow0, pRow1, pOut, w2, kernel); break;
+	case 3:  Reduce<3>(pRow0, pRow1, pOut, w2, kernel); break;
+	case 4:  Reduce<4>(pRow0, pRow1, pOut, w2, kernel); break;
+	default: assert(false); break;
+	}
+}
+
+
+
+
+/** Reduces the row y of the level l from the two rows above */
+static inline void ReduceLevelRow(const ImageView* pLevels, int l, int y, int comp)
+{
+	const ImageView& src = pLevels[l - 1];
+
+	ReduceRows(src.Row(y * 2), src.Row(y * 2 + 1), pLevels[l].Row(y), pLevels[l].w, comp);
+}
+
+/** The levels under a band of rows of the first level, starting at the row y. 
+ *  A row of a level is reduced as soon as the two rows above it are done, so 
+ *  they are read while still in cache */
+static void ReduceBand(const ImageView* pLevels, int levels, int y, int rows, int comp)
+{
+	for (int r = 0; r < rows / 2; r++)
+	{
+		ReduceLevelRow(pLevels, 1, y / 2 + r, comp);
+
+		//each odd row completes a pair for the level under it
+		int ly = r;
+
+		for (int l = 2; l < levels && ly % 2 == 1; l++)
+		{
+			ly /= 2;
+
+			ReduceLevelRow(pLevels, l, (y >> l) + ly, comp);
+		}
+	}
+}
+
+void ReduceChain(const ImageView* pLevels, int count, int comp)
+{
+	while (count > 1)
+	{
+		const ImageView& top = pLevels[0];
+
+		//a band of the top level is reduced down to a single row, the levels 
+		//under that are done by the next round from the last one
+		const int band = min(CHAIN_BAND, top.h);
+
+		int levels = 1;
+
+		while ((band >> (levels - 1)) > 1 && levels < count)
+		{
+			assert(pLevels[levels].w * 2 == pLevels[levels - 1].w);
+			assert(pLevels[levels].h * 2 == pLevels[levels - 1].h);
+
+			levels++;
+		}
+
+		//the last band might be shorter (not a power of 2 height), its rows 
+		//still halve down to the last level of the round
+		ParallelFor(0, (top.h + band - 1) / band, 1, [&](int first, int last)
+		{
+			for (int b = first; b < last; b++)
+			{
+				ReduceBand(pLevels, levels, b * band, min(band, top.h - b * band), comp);
+			}
+		});
+
+		pLevels += levels - 1;
+		count -= levels - 1;
+	}
+}
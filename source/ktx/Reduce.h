@@ -0,0 +1,71 @@
+/*
+ * ktxtool, A conversion and compression tool for the KTX image format
+ *
+ * Copyright (C) 2014 Luis Jimenez, www.kvbits.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+ */
+
+#ifndef __KTXTOOL_REDUCE_INCLUDED
+#define __KTXTOOL_REDUCE_INCLUDED
+
+
+
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <ImageView.h>
+#include "Convert.h"
+
+
+
+
+
+/** 2:1 reduction of two 8-bit rows, the mipmap filter. Each output sample is
+ *  the rounded average of the 2x2 source samples under it, (a + b + c + d + 2) / 4,
+ *  so it's centered between the source pixels. Integer maths, the scalar and
+ *  the SIMD versions (the same set of kernels as the conversion) give the same
+ *  results. comp is the samples per pixel, 1 (a plane), 3 or 4. The source rows
+ *  have 2 * w2 pixels. */
+void ReduceRows(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pOut, int w2, int comp);
+
+
+
+
+/** Same as above with a given kernel, which must be supported */
+void ReduceRows(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pOut, int w2, int comp, ConvertKernel kernel);
+
+
+
+
+/** Fills the levels 1 to count - 1 with the 2:1 reduction of the level above,
+ *  the level 0 is the source and every level is exactly half the size of the
+ *  previous one (even sizes, the odd ones go through the filter tables).
+ *  Gives the same output as ReduceRows level by level, but the source is
+ *  walked in bands of rows and a row of a level is reduced as soon as the two
+ *  rows above it are done, while they are still in cache, so the source is
+ *  read once and every level is written once. The bands run in parallel */
+void ReduceChain(const ImageView* pLevels, int count, int comp);
+
+
+
+
+
+
+
+
+
+
+#endif
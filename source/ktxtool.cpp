@@ -27,13 +27,17 @@
 #include <string>
 #include <fstream>
 #include <assert.h>
+#include <stdlib.h>
 #include <iomanip>
+#include <algorithm>
 #include "InputFormat.h"
-#include "ktx/Container.h"
-#include "PixelData.h"
-
-#include "ktx/Compression/Compression.h"
-#include "ktx/Compression/ETC1/ETC1.h"
+#include "Job.h"
+#include "Batch.h"
+#include "Cache.h"
+#include "Dependencies.h"
+#include "Parallel.h"
+#include "Buffer.h"
+#include "ktx/Filter.h"
 
 
 
@@ -69,7 +73,25 @@ Option* GetOption(char id)
 	return NULL;
 }
 
-Option& AddOption(char id, int flags, const char* desc)
+Option* GetOption(const string& name)
+{
+	OptionMap::iterator it = options.begin();
+
+	while (it != options.end())
+	{
+		if (it->second.name == name)
+		{
+			return &it->second;
+		}
+
+		it++;
+	}
+
+
+	return NULL;
+}
+
+Option& AddOption(char id, int flags, const char* desc, const char* name)
 {
 	assert(GetOption(id) == NULL);
 
@@ -80,6 +102,12 @@ Option& AddOption(char id, int flags, const char* desc)
 	opt.flags = flags;
 	opt.desc = desc;
 
+	if (name)
+	{
+		assert(GetOption(string(name)) == NULL);
+		opt.name = name;
+	}
+
 	return opt;
 }
 
@@ -89,6 +117,38 @@ void AddInputFormat(InputFormat* pFormat)
 	formats.push_back(pFormat);
 }
 
+InputFormat* FindInputFormat(const string& filePath)
+{
+	size_t dotAt = filePath.find_last_of('.');
+
+	if (dotAt == string::npos)
+	{
+		return NULL;
+	}
+
+	//get the extension
+	string strExt = filePath.substr(dotAt + 1);
+
+	if (strExt.size() == 0)
+	{
+		return NULL;
+	}
+
+	FormatList::iterator it = formats.begin();
+
+	while (it != formats.end())
+	{
+		if ((*it)->CheckExtension(strExt.c_str()))
+		{
+			return (*it);
+		}
+
+		it++;
+	}
+
+	return NULL;
+}
+
 static void DumpOptions()
 {
 	OptionMap::iterator it = options.begin();
@@ -116,10 +176,18 @@ static void DumpOptions()
 			flags += "OPTION_REQUIRED ";
 		}
 
-		cout << "    -" << opt.id << " ";
+		string strID = "-";
+		strID += opt.id;
+
+		if (opt.name.size())
+		{
+			strID += " --" + opt.name;
+		}
+
+		cout << "    " << left << setfill(' ') << setw(18) << strID << right;
 		
 		//cout << setfill(' ') << setw(15) << opt.value << " : " << flags << endl;
-		cout << setfill(' ') << setw(15) << "  :  ";
+		cout << "  :  ";
 		cout << opt.desc;
 
 		cout << endl;
@@ -145,8 +213,10 @@ static void DumpSupportedFormats()
 
 static void DumpHelp()
 {
-	cout << "ktxtool v0.2.0" << endl << endl;
-	cout << "  Usage: ktxtool -[OPTIONS]... FILEIN [FILEOUT]" << endl << endl;
+	cout << "ktxtool v" << KTXTOOL_VERSION << endl << endl;
+	cout << "  Usage: ktxtool -[OPTIONS]... FILEIN [FILEOUT]" << endl;
+	cout << "         ktxtool --manifest FILE" << endl;
+	cout << "         ktxtool --src-dir DIR --out-dir DIR" << endl << endl;
 	
 	DumpOptions();
 
@@ -158,18 +228,60 @@ static void DumpHelp()
 
 }
 
-static bool FileExists(const string& filePath)
+/** The colour conversion of the options, --to-linear or --to-srgb */
+static ColorTransform GetColorTransform()
 {
-	ifstream file(filePath.c_str());
+	if (GetOption('l')->IsDefined())
+	{
+		return COLOR_TRANSFORM_SRGB_TO_LINEAR;
+	}
 
-	if (file.good())
+	if (GetOption('g')->IsDefined())
 	{
-		file.close();
-		return true;
+		return COLOR_TRANSFORM_LINEAR_TO_SRGB;
 	}
 
-	file.close();
-	return false;
+	return COLOR_TRANSFORM_NONE;
+}
+
+/** Runs the jobs of a manifest or a source tree, with a dependency database
+ *  only the outdated jobs are converted */
+static int RunBatchJobs(JobArray& jobs, const BatchSettings& settings, const string& dependencies)
+{
+	DependencyDB db;
+
+	if (dependencies.size())
+	{
+		if (!db.Load(dependencies))
+		{
+			return 16;
+		}
+
+		JobArray outdated;
+
+		db.Check(jobs, outdated);
+
+		cout << (jobs.size() - outdated.size()) << "/" << jobs.size() << " jobs up to date" << endl;
+
+		jobs.swap(outdated);
+	}
+
+	int result = RunBatch(jobs, settings);
+
+	if (dependencies.size())
+	{
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			if (jobs[i].result == 0)
+			{
+				db.Update(jobs[i]);
+			}
+		}
+
+		db.Save();
+	}
+
+	return result;
 }
 
 int main (int argc, char* argv[])
@@ -181,6 +293,23 @@ int main (int argc, char* argv[])
 	AddOption('o', OPTION_EXPECTS_VALUE, "Output file");
 	AddOption('d', 0, "Dumps mipmaps as individual ppm files");
 	AddOption('y', 0, "Flips the Y Axis or upside down");
+	AddOption('p', 0, "Premultiplies the color by the alpha", "premultiply");
+	AddOption('l', 0, "Converts the color from sRGB to linear", "to-linear");
+	AddOption('g', 0, "Converts the color from linear to sRGB", "to-srgb");
+	AddOption('F', OPTION_EXPECTS_VALUE, "Mipmap filter: box, kaiser, lanczos3 or mitchell (box)", "mip-filter");
+	AddOption('m', OPTION_EXPECTS_VALUE, "Batch manifest file, one job per line: [-OPTIONS] FILEIN [FILEOUT]", "manifest");
+	AddOption('t', OPTION_EXPECTS_VALUE, "Number of threads, all the cores by default", "threads");
+	AddOption('s', OPTION_EXPECTS_VALUE, "Batch jobs per stage: DECODE,CONVERT,ENCODE,WRITE (2,1,1,1)", "stages");
+	AddOption('i', 0, "Batch jobs start in order instead of the most expensive first", "in-order");
+	AddOption('M', OPTION_EXPECTS_VALUE, "Batch memory budget in MB, jobs wait until there's room (unlimited)", "max-memory");
+	AddOption('H', 0, "Batch image buffers backed by huge pages, if the system allows it", "huge-pages");
+	AddOption('x', OPTION_EXPECTS_VALUE, "Scratch directory, large images are kept in files there instead of memory", "scratch");
+	AddOption('X', OPTION_EXPECTS_VALUE, "Minimum image size in MB to use a scratch file (256)", "scratch-min");
+	AddOption('k', OPTION_EXPECTS_VALUE, "Cache directory, unchanged inputs reuse the previous output", "cache");
+	AddOption('K', OPTION_EXPECTS_VALUE, "Cache size limit in MB (1024)", "cache-size");
+	AddOption('S', OPTION_EXPECTS_VALUE, "Source directory, converts every supported image file in it (recursively)", "src-dir");
+	AddOption('O', OPTION_EXPECTS_VALUE, "Output directory for --src-dir", "out-dir");
+	AddOption('D', OPTION_EXPECTS_VALUE, "Dependency database, only the jobs whose inputs changed are converted", "dependencies");
 
 
 	if (argc < 2)
@@ -219,12 +348,15 @@ int main (int argc, char* argv[])
 
 		bool validOptionID = (argStr.size() == 2 && argStr[0] == '-');
 
+		//long options, ie. --manifest
+		bool validOptionName = (argStr.size() > 2 && argStr[0] == '-' && argStr[1] == '-');
+
 
 
 		if (optionIDMode)
 		{
 			//check if it's a valid option
-			if (!validOptionID)
+			if (!validOptionID && !validOptionName)
 			{
 				//At this point the execution is still valid
 				break;
@@ -232,7 +364,7 @@ int main (int argc, char* argv[])
 			
 			assert(argStr.size() >= 2);
 
-			opt = GetOption(argStr[1]);
+			opt = validOptionName ? GetOption(argStr.substr(2)) : GetOption(argStr[1]);
 
 			if (opt == NULL)
 			{
@@ -257,7 +389,7 @@ int main (int argc, char* argv[])
 		{
 			assert(opt != NULL);
 
-			if (validOptionID)
+			if (validOptionID || validOptionName)
 			{
 				//this will trigger the error bellow
 				break;
@@ -277,207 +409,253 @@ int main (int argc, char* argv[])
 		return 4;
 	}
 
-	//now parse the "auto" options -f and -o, error if already defined direclty
-	Option* opt1 = GetOption('f');
-	Option* opt2 = GetOption('o');
-	
-	assert(opt1 != NULL && opt2 != NULL);
-
+	Option* optThreads = GetOption('t');
 
-	if (argc - parsedArg > 0)
+	if (optThreads->IsDefined())
 	{
-		if (opt1->IsDefined())
+		int threads = atoi(optThreads->value.c_str());
+
+		if (threads <= 0)
 		{
-			cerr << "Unexpected input file, -f already defined" << endl;
-			return 5;
+			cerr << "Invalid number of threads " << optThreads->value << endl;
+			return 3;
 		}
 
-		opt1->MarkAsDefined();
-		opt1->value = argv[parsedArg];
+		SetThreadCount(threads);
 	}
 
-	if (argc - parsedArg > 1)
+	if (GetOption('l')->IsDefined() && GetOption('g')->IsDefined())
 	{
-		if (opt2->IsDefined())
-		{
-			cerr << "Unexpected output file, -O already defined" << endl;
-			return 6;
-		}
-
-		opt2->MarkAsDefined();
-		opt2->value = argv[parsedArg + 1];
+		cerr << "Either --to-linear or --to-srgb, not both" << endl;
+		return 5;
 	}
 
-	//pre-validate options
-	OptionMap::iterator it = options.begin();
+	MipFilter mipFilter = MIP_FILTER_BOX;
 
-	while (it != options.end())
-	{
-		Option& opt = it->second;
+	Option* optMipFilter = GetOption('F');
 
-		if (opt.IsRequired() && !opt.IsDefined())
-		{
-			cerr << "option -" << opt.id << " is required (" << opt.desc << ")" << endl;
+	if (optMipFilter->IsDefined() && !GetMipFilter(optMipFilter->value.c_str(), mipFilter))
+	{
+		cerr << "Unknown mipmap filter " << optMipFilter->value << ", expected box, kaiser, lanczos3 or mitchell" << endl;
+		return 3;
+	}
 
-			return opt.id + 256;
-		}
+	//out of core images
+	Option* optScratch = GetOption('x');
 
-		it++;
-	}
+	if (optScratch->IsDefined())
+	{
+		uint64_t scratchMin = 256;
 
+		Option* optScratchMin = GetOption('X');
 
-	
-	//define some variables
-	Container ktx; //this holds float/32bit color data only
+		if (optScratchMin->IsDefined())
+		{
+			char* pEnd = NULL;
 
+			//zero is fine, every image goes to a scratch file
+			scratchMin = strtoull(optScratchMin->value.c_str(), &pEnd, 10);
 
-	Compression* pComp = nullptr;
+			if (pEnd == optScratchMin->value.c_str() || *pEnd != '\0')
+			{
+				cerr << "Invalid scratch size " << optScratchMin->value << endl;
+				return 3;
+			}
+		}
 
-	if (GetOption('c')->IsDefined())
-	{
-		pComp = new ETC1();
-		pComp->SetQuality(Compression::QUALITY_HIGH);
+		Buffer::SetScratch(optScratch->value, max<uint64_t>(1, scratchMin << 20));
 	}
 
+	//output cache
+	OutputCache cache;
+	OutputCache* pCache = NULL;
 
-	//The faces
-	vector<string> faces;
-	
-	std::istringstream ss(opt1->value);
-	std::string token;
+	Option* optCache = GetOption('k');
 
-	//extract the filenames as faces
-	while (std::getline(ss, token, ','))
+	if (optCache->IsDefined())
 	{
-		faces.push_back(token);
-	}
+		uint64_t cacheSize = 1024;
 
+		Option* optCacheSize = GetOption('K');
 
-	//all faces should match this format, width and height (taken from index 0)
-	Format refFormat;
-	float  refWidth;
-	float  refHeight;
+		if (optCacheSize->IsDefined())
+		{
+			char* pEnd = NULL;
 
-	//process all the faces	
-	for (size_t i = 0; i < faces.size(); i++)
-	{
-		const string& fileName = faces[i];
+			cacheSize = strtoull(optCacheSize->value.c_str(), &pEnd, 10);
 
-		cout << "Processing face at index " << i << ": " << fileName << endl;
+			if (cacheSize == 0 || *pEnd != '\0')
+			{
+				cerr << "Invalid cache size " << optCacheSize->value << endl;
+				return 3;
+			}
+		}
 
-		//check if the file exists
-		if (!FileExists(fileName))
+		if (!cache.Open(optCache->value, cacheSize << 20))
 		{
-			cerr << "Input file  doesn't exist" << endl;
-			return 7;
+			return 18;
 		}
 
-		//get the extension
-		string strExt = opt1->value.substr(opt1->value.find_last_of(".") + 1);
+		pCache = &cache;
+	}
 
-		if (strExt.size() == 0)
+	//the settings of the job, in batch mode the defaults of every job
+	Job defaults;
+	defaults.compress = GetOption('c')->IsDefined();
+	defaults.flipY = GetOption('y')->IsDefined();
+	defaults.dumpMipmaps = GetOption('d')->IsDefined();
+	defaults.mipFilter = mipFilter;
+	defaults.premultiply = GetOption('p')->IsDefined();
+	defaults.colorTransform = GetColorTransform();
+
+	//batch mode, all the jobs are defined in the manifest or the source tree
+	Option* optManifest = GetOption('m');
+	Option* optSrcDir = GetOption('S');
+	Option* optOutDir = GetOption('O');
+	Option* optDependencies = GetOption('D');
+
+	if (optManifest->IsDefined() || optSrcDir->IsDefined())
+	{
+		if (argc - parsedArg > 0 || GetOption('f')->IsDefined())
 		{
-			cerr << "Input file has no extension, therefore unabled to determine its format" << endl;
-			return 10;
+			cerr << "Unexpected input file, --manifest/--src-dir already defines the jobs" << endl;
+			return 5;
 		}
 
-		//Lookup for a compatible format
-		InputFormat* pFormat = nullptr;
+		BatchSettings settings;
+		settings.pCache = pCache;
+		settings.schedule = !GetOption('i')->IsDefined();
+		settings.hugePages = GetOption('H')->IsDefined();
 
-		FormatList::iterator it = formats.begin();
+		Option* optStages = GetOption('s');
 
-		while (it != formats.end())
+		if (optStages->IsDefined() && !ParseStageLimits(optStages->value, settings))
 		{
+			cerr << "Invalid stage limits " << optStages->value << ", expected DECODE,CONVERT,ENCODE,WRITE" << endl;
+			return 3;
+		}
 
-			if ((*it)->CheckExtension(strExt.c_str()))
-			{
-				pFormat = (*it);
-				break;
-			}
+		Option* optMaxMemory = GetOption('M');
 
-			it++;
-		}
-		
-		if (pFormat == nullptr)
+		if (optMaxMemory->IsDefined())
 		{
-			cerr << "Input format is not supported" << endl;
-			return 8;
-		}
+			char* pEnd = NULL;
 
-		assert(pFormat != nullptr);
+			settings.maxMemory = strtoull(optMaxMemory->value.c_str(), &pEnd, 10) << 20;
 
-		//Create the pixel data and add the face into the ktx container
-		PixelData* pPixelData = pFormat->CreatePixelData(fileName.c_str());
-
-		if (pPixelData == nullptr)
-		{
-			cerr << "Couldn't create pixel data from input file" << endl;
-			return 11;
+			if (settings.maxMemory == 0 || *pEnd != '\0')
+			{
+				cerr << "Invalid memory budget " << optMaxMemory->value << endl;
+				return 3;
+			}
 		}
 
-		const float  w = pPixelData->GetWidth();
-		const float  h = pPixelData->GetHeight();
-		const Format f = pPixelData->GetFormat(); 
-		
-		//if first face then initialize the container
-		if (i == 0)
+		JobArray jobs;
+		string dependencies = optDependencies->value;
+
+		if (optManifest->IsDefined())
 		{
-			refFormat = f;
-			refWidth = w;
-			refHeight = h;
+			if (optSrcDir->IsDefined())
+			{
+				cerr << "Either --manifest or --src-dir, not both" << endl;
+				return 5;
+			}
 
-			ktx.Init(w, h, 1, faces.size());
-			ktx.SetFormat(f, COLOR_DEPTH_8BIT, pComp);
+			if (!ReadManifest(optManifest->value.c_str(), defaults, jobs))
+			{
+				return 16;
+			}
 		}
-
-		if (!(refFormat == f && refWidth == w && refHeight == h))
+		else
 		{
-			cerr << "Format/Dimmension mismatch, all faces should match the face at index 0" << endl;
-			return 15;
-		}
+			if (!optOutDir->IsDefined())
+			{
+				cerr << "option --out-dir is required with --src-dir" << endl;
+				return 6;
+			}
 
-		ktx.SetData(0, i, pPixelData);
+			if (!ReadSourceTree(optSrcDir->value, optOutDir->value, defaults, jobs))
+			{
+				return 16;
+			}
 
-		//we don't need the pixel data anymore
-		delete pPixelData;
-	}
+			//source trees are always incremental
+			if (!optDependencies->IsDefined())
+			{
+				dependencies = optOutDir->value + "/.ktxtool-dependencies";
+			}
+		}
 
+		return RunBatchJobs(jobs, settings, dependencies);
+	}
 
-	//setup the output file and write the container
-	string outputFile = opt2->value;
+	//the batch settings mean nothing to a single job, better an error than ignoring them
+	const char batchOptions[] = { 's', 'i', 'M', 'H', 'D', 'O' };
 
-	if (outputFile.size() == 0)
+	for (size_t i = 0; i < sizeof(batchOptions); i++)
 	{
-		assert(faces.size() >= 1);
-
-		size_t dotAt = faces[0].find_last_of('.');
+		Option* optBatch = GetOption(batchOptions[i]);
 
-		outputFile = faces[0].substr(0, dotAt);
-		outputFile += ".ktx";
+		if (optBatch->IsDefined())
+		{
+			cerr << "option --" << optBatch->name << " needs --manifest or --src-dir" << endl;
+			return 5;
+		}
 	}
-	
-	ktx.GenerateMipmaps();
-
-	ktx.Write(outputFile.c_str());
-
-
-
-
-	return 0;
-}
 
+	//now parse the "auto" options -f and -o, error if already defined direclty
+	Option* opt1 = GetOption('f');
+	Option* opt2 = GetOption('o');
+	
+	assert(opt1 != NULL && opt2 != NULL);
 
 
+	if (argc - parsedArg > 0)
+	{
+		if (opt1->IsDefined())
+		{
+			cerr << "Unexpected input file, -f already defined" << endl;
+			return 5;
+		}
 
+		opt1->MarkAsDefined();
+		opt1->value = argv[parsedArg];
+	}
 
+	if (argc - parsedArg > 1)
+	{
+		if (opt2->IsDefined())
+		{
+			cerr << "Unexpected output file, -O already defined" << endl;
+			return 6;
+		}
 
+		opt2->MarkAsDefined();
+		opt2->value = argv[parsedArg + 1];
+	}
 
+	//pre-validate options
+	OptionMap::iterator it = options.begin();
 
+	while (it != options.end())
+	{
+		Option& opt = it->second;
 
+		if (opt.IsRequired() && !opt.IsDefined())
+		{
+			cerr << "option -" << opt.id << " is required (" << opt.desc << ")" << endl;
 
+			return opt.id + 256;
+		}
 
+		it++;
+	}
 
 
 
+	Job job = defaults;
 
+	SetJobFiles(job, opt1->value, opt2->value);
 
+	return RunJob(job, pCache);
+}
@@ -28,6 +28,9 @@
 
 
 
+#define KTXTOOL_VERSION "0.2.0"
+
+
 class InputFormat;
 
 
@@ -45,6 +48,7 @@ struct Option
 
 	char   id;
 	int    flags;
+	String name;
 	String value;
 	String desc;
 
@@ -83,9 +87,15 @@ struct Option
 Option* GetOption(char id);
 
 
+/** Gets a proccesed option from it's long name, ie. --manifest 
+ *  Returns NULL if not found */
+Option* GetOption(const std::string& name);
+
+
 /** Adds an option to be processed, this should be called ealry 
- *  in the main function */
-Option& AddOption(char id, int flags, const char* desc);
+ *  in the main function. The optional name allows the option to 
+ *  be used as --{NAME} aswell */
+Option& AddOption(char id, int flags, const char* desc, const char* name = NULL);
 
 
 
@@ -94,6 +104,12 @@ void AddInputFormat(InputFormat* pFormat);
 
 
 
+/** Looks up a registered input format by the file extension.
+ *  Returns NULL if the file has no extension or isn't supported */
+InputFormat* FindInputFormat(const std::string& filePath);
+
+
+
 
 
 